@@ -0,0 +1,91 @@
+#ifndef _APP_CONFIG_H_
+#define _APP_CONFIG_H_
+
+#include <avr/io.h>
+
+// Sizes the firmware is built with. The rest below is derived from them and checked,
+// so a variant tuned for capacity or throughput, e.g. CC_FLAGS += -DPWD_COUNT=8 -DPWD_SIZE=64,
+// fails to compile rather than overflow a buffer or the eeprom.
+
+#ifndef PWD_SIZE
+#define PWD_SIZE 32 // bytes per slot, a multiple of the 8 byte XTEA block
+#endif
+
+#ifndef PWD_COUNT
+#define PWD_COUNT 16 // slots, slot 0 holds the device settings
+#endif
+
+#ifndef CDC_TXRX_EPSIZE
+#define CDC_TXRX_EPSIZE 16 // CDC data IN and OUT endpoints
+#endif
+
+#ifndef SER_RING_SIZE
+#define SER_RING_SIZE 64 // txbuf and rxbuf in s_main.c, rxbuf is the typing pipe's ring too
+#endif
+
+#define CONTROL_EPSIZE 8 // FIXED_CONTROL_ENDPOINT_SIZE in LUFAConfig.h
+#define KEYBOARD_EPSIZE 8 // boot protocol keyboard report
+#define CDC_NOTIFICATION_EPSIZE 8
+#define PROV_EPSIZE 8 // provisioning HID IN endpoint, nothing is sent on it
+
+// longest setup mode command line, m#= with a full slot of hex and the terminating zero
+#define SER_LINE_SIZE (3 + 2 * PWD_SIZE + 1)
+
+// feature report n (1..PWD_COUNT-1) carries a status byte and slots n and n+1 after its report id byte
+#define PROV_SLOTS 2
+#define PROV_REPORT_SIZE (1 + PROV_SLOTS * PWD_SIZE)
+
+// eeprom address of last recorded scheduler trap, after the slots
+#define TRAP_EEADDR (PWD_SIZE * PWD_COUNT)
+
+// endpoint memory
+#if defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega16U4__)
+#define EP_DPRAM_SIZE 832
+#else
+#define EP_DPRAM_SIZE 176 // atmega32u2 and its 8u2/16u2 siblings
+#endif
+#define EP_MAX_SIZE 64 // endpoints 1..4, all that every supported MCU has
+
+// endpoint memory each personality takes, as configured in *_main.c
+#define K_DPRAM (CONTROL_EPSIZE + 2 * KEYBOARD_EPSIZE + KEYBOARD_EPSIZE)
+#define P_DPRAM (CONTROL_EPSIZE + 2 * KEYBOARD_EPSIZE + CDC_NOTIFICATION_EPSIZE + 2 * CDC_TXRX_EPSIZE)
+#define S_DPRAM (CONTROL_EPSIZE + PROV_EPSIZE + CDC_NOTIFICATION_EPSIZE + 2 * CDC_TXRX_EPSIZE)
+
+#define IS_POW2(x) ((x) && !((x) & ((x) - 1)))
+
+#if (PWD_SIZE < 8) || (PWD_SIZE % 8)
+#error PWD_SIZE must be a multiple of the XTEA block
+#endif
+
+#if (PWD_COUNT < 2) || (PWD_COUNT > 16)
+#error PWD_COUNT must be 2..16, slots are addressed by one hex digit and four dip switches
+#endif
+
+// the trap record is checked against E2END in sched.c, where its size is known
+#if TRAP_EEADDR > E2END
+#error slots do not fit the eeprom
+#endif
+
+#if SER_LINE_SIZE > 255
+#error PWD_SIZE too large for a setup mode command line
+#endif
+
+#if PROV_REPORT_SIZE > 255
+#error PWD_SIZE too large for a HID feature report
+#endif
+
+// a power of two ring at least a packet long holds a whole number of packets,
+// so the OUT endpoint is only held off when the ring is really full
+#if !IS_POW2(SER_RING_SIZE) || (SER_RING_SIZE > 128) || (SER_RING_SIZE < CDC_TXRX_EPSIZE)
+#error SER_RING_SIZE must be a power of two from CDC_TXRX_EPSIZE to 128
+#endif
+
+#if !IS_POW2(CDC_TXRX_EPSIZE) || (CDC_TXRX_EPSIZE < 8) || (CDC_TXRX_EPSIZE > EP_MAX_SIZE)
+#error CDC_TXRX_EPSIZE must be 8, 16, 32 or 64
+#endif
+
+#if (K_DPRAM > EP_DPRAM_SIZE) || (P_DPRAM > EP_DPRAM_SIZE) || (S_DPRAM > EP_DPRAM_SIZE)
+#error endpoints do not fit the endpoint memory
+#endif
+
+#endif
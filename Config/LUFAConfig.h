@@ -1,6 +1,8 @@
 #ifndef _LUFA_CONFIG_H_
 #define _LUFA_CONFIG_H_
 
+#include "AppConfig.h"
+
 	#if (ARCH == ARCH_AVR8)
 
 		/* Non-USB Related Configuration Tokens: */
@@ -21,7 +23,7 @@
 		#define USB_DEVICE_ONLY
 //		#define USB_HOST_ONLY
 //		#define USB_STREAM_TIMEOUT_MS            {Insert Value Here}
-//		#define NO_LIMITED_CONTROLLER_CONNECT
+		#define NO_LIMITED_CONTROLLER_CONNECT    // suspend and wakeup events instead of disconnect and connect
 //		#define NO_SOF_EVENTS
 
 		/* USB Device Mode Driver Related Tokens: */
@@ -29,11 +31,11 @@
 		#define USE_FLASH_DESCRIPTORS
 //		#define USE_EEPROM_DESCRIPTORS
 //		#define NO_INTERNAL_SERIAL
-		#define FIXED_CONTROL_ENDPOINT_SIZE      8
+		#define FIXED_CONTROL_ENDPOINT_SIZE      CONTROL_EPSIZE
 //		#define DEVICE_STATE_AS_GPIOR            {Insert Value Here}
 		#define FIXED_NUM_CONFIGURATIONS         1
 //		#define CONTROL_ONLY_DEVICE
-//		#define INTERRUPT_CONTROL_ENDPOINT
+		#define INTERRUPT_CONTROL_ENDPOINT
 //		#define NO_DEVICE_REMOTE_WAKEUP
 //		#define NO_DEVICE_SELF_POWER
 
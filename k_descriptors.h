@@ -5,6 +5,8 @@
 
 #include <avr/pgmspace.h>
 
+#include "Config/AppConfig.h" // endpoint sizes
+
 /* Type define for the device configuration descriptor structure. This must be defined in the
 	application code, as the configuration descriptor contains several sub-descriptors which
 	vary between devices, and which describe the device's usage to the host. */
@@ -43,7 +45,4 @@ enum StringDescriptors_t
 // Endpoint address of the Keyboard HID reporting OUT endpoint.
 #define KEYBOARD_OUT_EPADDR       (ENDPOINT_DIR_OUT | 2)
 
-// Size in bytes of the Keyboard HID reporting IN and OUT endpoints.
-#define KEYBOARD_EPSIZE           8
-
 #endif
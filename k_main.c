@@ -1,100 +1,291 @@
 #include <avr/eeprom.h>
-#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #include "k_descriptors.h"
+#include "sched.h"
+#include "totp.h"
+#include "slot.h"
+#include "layout.h"
 #include "main.h"
 
 #include <LUFA/Drivers/USB/USB.h>
 
 static bool UsingReportProtocol = true; // meaningless (desc declared report proto = boot proto)
 
-static uint16_t idle_rate = 500;
-static uint16_t idle_cnt = 0;
-static uint16_t sof_cnt = 0;
+// Control requests are served from the USB interrupt (INTERRUPT_CONTROL_ENDPOINT) and SOF counts
+// in the USB general interrupt, so what they share with the tasks is volatile and read or
+// changed with interrupts off when it's more than a byte.
+static volatile uint16_t idle_rate = 500;
+static volatile uint16_t idle_cnt = 0;
+static volatile uint16_t sof_cnt = 0;
+static USB_KeyboardReport_Data_t sent; // last report on the endpoint, GET_REPORT returns it
+
+static uint8_t slot_no; // number of the typed slot
+static uint8_t slot[PWD_SIZE]; // plaintext of the typed slot, decrypted at boot or when picked over the LED channel
+static uint8_t layout = 0; // device layout, OP_LAYOUT changes it for the rest of the slot
+static uint8_t caps_mode; // CAPS_*
+static volatile uint8_t leds = 0; // host's lock key LEDs, from the last LED report
+
+static uint8_t totp_state = 0; // 0 not computed yet, 1 no code, 2 code valid
+static uint8_t check_state = 0; // 0 not checked yet, 1 slot corrupt, 2 slot intact
+static char totp[TOTP_DIGITS];
+
+static const char test_chars[] PROGMEM = TEST_CHARS;
+static const uint8_t ledsel_marker[3] PROGMEM = {3, 0, 3}; // LED channel frame start, see main.h
+
+#define LEDSEL_REQ 0x80
+static volatile uint8_t ledsel = 0; // LEDSEL_REQ | slot when the LED channel or Wake_Task picked a slot
+static uint8_t restart = 0; // start typing the slot over
+
+// sof_cnt in one piece, the SOF interrupt may come between its bytes
+static uint16_t SofCount(void)
+{
+	uint8_t g = SREG;
+	cli();
+	uint16_t n = sof_cnt;
+	SREG = g;
+	return n;
+}
+
+_Static_assert(sizeof(USB_KeyboardReport_Data_t) == KEYBOARD_EPSIZE, "keyboard report doesn't fill the endpoint");
+
+// char to keyboard scan code in the current layout, 2 if it's a dead key that needs a space after it
+uint8_t c2ksc(const char c, uint8_t* ksc, uint8_t* mod)
+{
+	return layout_c2ksc(layout, c, ksc, mod);
+}
 
-void rep_size_check(void)
+// Decrypts the given slot, so typing reads plaintext from SRAM.
+void LoadSlot(const uint8_t n)
 {
-	switch(0) {case 0:case sizeof(USB_KeyboardReport_Data_t) == 8:;}
+	slot_no = n;
+	memset(slot, 0, PWD_SIZE); // a dip or LED channel address past the slots built in types nothing
+	if( n < PWD_COUNT ) { slot_read(n, slot); }
+	layout = eeprom_read_byte((void*)META_LAYOUT);
+	if( layout >= LAYOUT_COUNT ) { layout = 0; } // never set
+	caps_mode = eeprom_read_byte((void*)META_CAPS);
 }
 
-// index of char in string or 0xff if not found
-uint8_t istrchr(const char* s, const char c)
+// Presses caps lock, and expects the host to toggle its LED, which the next LED report confirms.
+static void CapsTap(USB_KeyboardReport_Data_t* const rep)
 {
-	uint8_t i = 0;
+	rep->KeyCode[0] = HID_KEYBOARD_SC_CAPS_LOCK;
+
+	uint8_t g = SREG;
+	cli();
+	leds ^= HID_KEYBOARD_LED_CAPSLOCK;
+	SREG = g;
+}
 
-	while( *s ) {
-		if( *s == c ) return i;
-		++i;
-		++s;
+// char n of the test pattern, see TEST_CHARS in main.h
+static uint8_t test_char(const uint16_t n)
+{
+	uint8_t j = n % (sizeof(test_chars) - 1);
+	uint16_t b = n / (sizeof(test_chars) - 1);
+	if( j < TEST_MARK ) { // digit j of the block number
+		while( j-- ) b /= sizeof(test_chars) - 1;
+		j = b % (sizeof(test_chars) - 1);
 	}
+	return pgm_read_byte(&test_chars[j]);
+}
 
-	return 0xff;
+// byte at pc of the typed slot, 0 (end) past the slot
+static uint8_t slot_byte(const uint8_t pc)
+{
+	if( pc >= PWD_SIZE ) return OP_END;
+	return slot[pc];
 }
 
-// char to keyboard scan code
-uint8_t c2ksc(const char c, uint8_t* ksc, uint8_t* mod)
+// Fills the given HID report data structure with the next HID report to send to the host.
+// Runs the slot bytecode (see main.h) until an op produces a key or has to wait.
+void CreateKeyboardReport(USB_KeyboardReport_Data_t* const rep)
 {
-	if( (c < 32) || (c > 126) ) return 0;
+	static uint8_t pc = 0;
+	static uint8_t digit = TOTP_DIGITS; // next totp digit to type
+	static uint8_t held = 0; // last report had a key down
+	static uint8_t dead = 0; // last key was a dead key, space follows
+	static uint8_t delay = 0;
+	static uint16_t until; // sof_cnt at end of delay
+	static uint8_t capsoff = 0; // caps lock was tapped off, tap it on after the slot
+	static uint16_t test = 0; // test pattern chars left to type
+	static uint16_t test_pos; // position of the next test pattern char
+	static uint8_t period; // frames from key to key in the test pattern, 0 as fast as the host polls
+
+	if( restart ) {
+		restart = 0;
+		pc = 0;
+		digit = TOTP_DIGITS;
+		held = dead = 0; // capsoff stays, so caps lock is restored once
+		test = 0;
+		until = SofCount() + LEDSEL_SETTLE; // lets the host put its lock keys back first
+		delay = 1;
+	}
 
-	if( (c >= 'a') && (c <= 'z') ) {
-		*ksc = HID_KEYBOARD_SC_A + (c - 'a');
-		*mod = 0;
-		return 1;
+	if( held ) { held = 0; return; } // release between keys, also lets the same key repeat
+
+	if( dead ) {
+		dead = 0;
+		rep->KeyCode[0] = HID_KEYBOARD_SC_SPACE;
+		held = 1;
+		return;
 	}
 
-	if( (c >= 'A') && (c <= 'Z') ) {
-		*ksc = HID_KEYBOARD_SC_A + (c - 'A');
-		*mod = HID_KEYBOARD_MODIFIER_LEFTSHIFT;
-		return 1;
+	if( delay ) {
+		if( (int16_t)(SofCount() - until) < 0 ) return;
+		delay = 0;
 	}
 
-	uint8_t i;
+	if( check_state == 0 ) return; // Check_Task hasn't run yet
+
+	while( (digit < TOTP_DIGITS) || test || (pc < PWD_SIZE) ) {
+		if( (caps_mode == CAPS_TAP) && (leds & HID_KEYBOARD_LED_CAPSLOCK) && ((digit < TOTP_DIGITS) || test || slot_byte(pc)) ) {
+			CapsTap(rep);
+			capsoff = 1;
+			held = 1;
+			return;
+		}
+
+		uint8_t op;
+		if( digit < TOTP_DIGITS ) { op = totp[digit++]; } else
+		if( test ) {
+			--test;
+			op = test_char(test_pos++);
+			if( period ) {
+				until = SofCount() + period;
+				delay = 1;
+			}
+		} else { op = slot_byte(pc++); }
+		uint8_t ksc, mod = 0;
+
+		if( op == OP_END ) { pc = PWD_SIZE; break; }
+
+		if( op == OP_TEST ) {
+			test = slot_byte(pc) | ((uint16_t)slot_byte(pc + 1) << 8);
+			period = slot_byte(pc + 2);
+			test_pos = 0;
+			pc += 3;
+			continue;
+		}
+
+		if( op == OP_TOTP ) {
+			if( totp_state == 0 ) { --pc; return; } // TOTP_Task hasn't run yet
+			uint8_t klen = slot_byte(pc);
+			pc = (klen < PWD_SIZE) ? pc + 1 + klen : PWD_SIZE;
+			if( totp_state == 2 ) { digit = 0; }
+			continue;
+		}
+
+		if( op == OP_LAYOUT ) {
+			uint8_t l = slot_byte(pc++);
+			if( l < LAYOUT_COUNT ) { layout = l; }
+			continue;
+		}
+
+		if( op & OP_DELAY ) {
+			until = SofCount() + ((uint16_t)(op & ~OP_DELAY) << 3);
+			delay = 1;
+			return;
+		}
+
+		if( op == OP_TAB ) { ksc = HID_KEYBOARD_SC_TAB; } else
+		if( op == OP_ENTER ) { ksc = HID_KEYBOARD_SC_ENTER; } else
+		if( op == OP_KEY ) { ksc = slot_byte(pc++); } else
+		if( op == OP_CHORD ) { mod = slot_byte(pc++); ksc = slot_byte(pc++); } else {
+			uint8_t r = c2ksc(op, &ksc, &mod);
+			if( !r ) continue; // skip what can't be typed
+			dead = (r == 2);
+			if( (leds & HID_KEYBOARD_LED_CAPSLOCK) && ((op | 0x20) >= 'a') && ((op | 0x20) <= 'z') ) {
+				mod ^= HID_KEYBOARD_MODIFIER_LEFTSHIFT; // caps lock would invert the case
+			}
+		}
 
-	const char* nums = "1234567890!\"#$%&/()=";
-	i = istrchr(nums, c);
-	if( i < strlen(nums) ) {
-		*ksc = HID_KEYBOARD_SC_1_AND_EXCLAMATION + (i % 10);
-		*mod = (i < 10) ? 0 : HID_KEYBOARD_MODIFIER_LEFTSHIFT;
-		return 1;
+		rep->Modifier = mod;
+		rep->KeyCode[0] = ksc;
+		held = 1;
+		return;
 	}
 
-	// Warning: caret ^, tilde ~ and accent ` not supported
-	const char* spec = " '?+*,;<.:>-_\\|[]{}@";
-	const uint8_t specksc[20] = {0x2c,0x2d,0x2d,0x2e,0x2e,0x36,0x36,0x36,0x37,0x37,0x37,0x38,0x38,0x14,0x1a,0x09,0x0a,0x05,0x11,0x19};
-	const uint8_t specmod[20] = {0   ,0   ,2   ,0   ,2   ,0   ,2   ,64  ,0   ,2   ,64  ,0   ,2   ,64  ,64  ,64  ,64  ,64  ,64  ,64  };
-	i = istrchr(spec, c);
-	if( i < strlen(spec) ) {
-		*ksc = specksc[i];
-		*mod = specmod[i];
-		return 1;
+	if( capsoff ) {
+		capsoff = 0;
+		CapsTap(rep);
+		held = 1;
 	}
+}
 
-	return 0;
+// Checks the slot's CRC once, during the start delay. A corrupt slot is cleared, so nothing is
+// typed, and the LED stays on until an intact slot is loaded.
+void Check_Task(void)
+{
+	if( check_state ) return;
+	check_state = ((slot_no < PWD_COUNT) && !slot_check(slot_no)) ? 1 : 2;
+
+	if( check_state == 1 ) {
+		memset(slot, 0, PWD_SIZE);
+		LED_PORT |= _BV(LED_BIT);
+	} else {
+		LED_PORT &= ~_BV(LED_BIT);
+	}
 }
 
-// Fills the given HID report data structure with the next HID report to send to the host.
-void CreateKeyboardReport(USB_KeyboardReport_Data_t* const rep)
+// Computes the slot's TOTP code once, during the start delay, as HMAC-SHA1 takes several ticks.
+void TOTP_Task(void)
 {
-	static uint8_t i = 0;
-	static uint8_t odd = 1;
+	if( totp_state ) return;
+	totp_state = totp_slot(totp, slot) ? 2 : 1;
+}
 
-	odd = !odd;
-	if( odd ) return;
+// Decodes a LED channel symbol (see main.h), posts the picked slot in ledsel when a frame completes.
+static void LedSel_Symbol(const uint8_t s)
+{
+	static uint8_t n = 0; // symbols of the frame received
+	static uint8_t v;
+	static uint16_t t; // sof_cnt at last symbol
 
-	if( i >= PWD_SIZE ) return;
+	uint16_t now = SofCount();
+	if( n && ((uint16_t)(now - t) > LEDSEL_TIMEOUT) ) { n = 0; }
+	t = now;
 
-	uint8_t c = eeprom_read_byte((void*)(PWD_SIZE * getswi() + i));
-	uint8_t ksc, mod;
-	if( c2ksc(c, &ksc, &mod) ) {
-		rep->Modifier = mod;
-		rep->KeyCode[0] = ksc;
-		++i;
+	if( n < sizeof(ledsel_marker) ) {
+		if( s == pgm_read_byte(&ledsel_marker[n]) ) { ++n; } else { n = (s == pgm_read_byte(&ledsel_marker[0])); }
+		return;
 	}
+
+	v = (v << 2) | s;
+	if( ++n < sizeof(ledsel_marker) + 3 ) return;
+	n = 0;
+
+	uint8_t hi = (v >> 4) & 3, lo = (v >> 2) & 3;
+	if( (v & 3) != (~(hi ^ lo) & 3) ) return;
+	ledsel = LEDSEL_REQ | (hi << 2) | lo;
+}
+
+// Loads the slot picked over the LED channel and types it from the start.
+static void LedSel_Load(void)
+{
+	uint8_t g = SREG;
+	cli();
+	uint8_t n = ledsel & ~LEDSEL_REQ;
+	ledsel = 0;
+	SREG = g;
+
+	LoadSlot(n ? n : slot_no);
+	totp_state = 0;
+	check_state = 0;
+	restart = 1;
 }
 
-// Processes a received LED report, and updates the board LEDs states to match.
+// Processes a received LED report, tracking caps lock and feeding scroll lock edges to the LED channel decoder.
+// Reports come from SET_REPORT in the USB interrupt or the OUT endpoint in HID_Task, so interrupts are off.
 void ProcessLEDReport(const uint8_t LEDReport)
 {
+	uint8_t g = SREG;
+	cli();
+	if( (LEDReport ^ leds) & HID_KEYBOARD_LED_SCROLLLOCK ) {
+		LedSel_Symbol(LEDReport & (HID_KEYBOARD_LED_NUMLOCK | HID_KEYBOARD_LED_CAPSLOCK));
+	}
+	leds = LEDReport;
+	SREG = g;
 }
 
 // Sends the next HID report to the host, via the keyboard data endpoint.
@@ -103,20 +294,22 @@ void SendNextReport(void)
 	// Select the Keyboard Report Endpoint
 	Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
 
-	// Check if Keyboard Endpoint Ready for Read/Write and if we should send a new report
-	if (Endpoint_IsReadWriteAllowed())
+	// Fill every free bank, so the next report is already waiting when the host takes one
+	while (Endpoint_IsReadWriteAllowed())
 	{
-		static USB_KeyboardReport_Data_t prev;
-
 		USB_KeyboardReport_Data_t rep;
 		memset(&rep, 0, sizeof(USB_KeyboardReport_Data_t));
-		if( sof_cnt > 1000 ) { CreateKeyboardReport(&rep); }
+		if( SofCount() > 1000 ) { CreateKeyboardReport(&rep); }
 
-		if( 0 == memcmp(&prev, &rep, sizeof(USB_KeyboardReport_Data_t)) ) {
-			if( idle_cnt ) return;
+		uint8_t g = SREG;
+		cli();
+		if( (0 == memcmp(&sent, &rep, sizeof(USB_KeyboardReport_Data_t))) && idle_cnt ) {
+			SREG = g;
+			return;
 		}
 		idle_cnt = idle_rate;
-		memcpy(&prev, &rep, sizeof(USB_KeyboardReport_Data_t));
+		memcpy(&sent, &rep, sizeof(USB_KeyboardReport_Data_t));
+		SREG = g;
 
 		// Write Keyboard Report Data
 		Endpoint_Write_Stream_LE(&rep, sizeof(USB_KeyboardReport_Data_t), NULL);
@@ -150,12 +343,38 @@ void ReceiveNextReport(void)
 	}
 }
 
+#define SW_WAKE_SETTLE 60 // ticks (16 ms while suspended) the dip switches must be still before waking the host
+
+// While the host is suspended, wakes it when the dip switches settle on another slot, which is then typed.
+void Wake_Task(void)
+{
+	static uint8_t last;
+	static uint8_t still = 0;
+
+	uint8_t sw = readswi();
+	if( (USB_DeviceState != DEVICE_STATE_Suspended) || (sw != last) ) {
+		last = sw;
+		still = 0;
+		return;
+	}
+	if( (sw == slot_no) || (sw == SW_SETUP_CMD) || (sw == SW_PIPE_CMD) || (sw == SW_ERASE_CMD) ) return;
+	if( still == SW_WAKE_SETTLE ) return; // woken already, or the host doesn't allow it
+	if( ++still < SW_WAKE_SETTLE ) return;
+
+	if( USB_Device_RemoteWakeupEnabled ) {
+		ledsel = LEDSEL_REQ | sw; // loaded and typed as if picked over the LED channel, once the host is back
+		USB_Device_SendRemoteWakeup();
+	}
+}
+
 // Function to manage HID report generation and transmission to the host, when in report mode.
 void HID_Task(void)
 {
 	// Device must be connected and configured for the task to run
 	if (USB_DeviceState != DEVICE_STATE_Configured) return;
 
+	if( ledsel ) { LedSel_Load(); }
+
 	// Send the next keypress report to the host
 	SendNextReport();
 
@@ -170,7 +389,7 @@ void k_EVENT_USB_Device_ConfigurationChanged(void)
 	bool ConfigSuccess = true;
 
 	// Setup HID Report Endpoints
-	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR, EP_TYPE_INTERRUPT, KEYBOARD_EPSIZE, 1);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR, EP_TYPE_INTERRUPT, KEYBOARD_EPSIZE, 2); // double banked
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_OUT_EPADDR, EP_TYPE_INTERRUPT, KEYBOARD_EPSIZE, 1);
 
 	// Turn on Start-of-Frame events for tracking HID report period expiry
@@ -188,15 +407,10 @@ void k_EVENT_USB_Device_ControlRequest(void)
 		case HID_REQ_GetReport:
 			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
 			{
-				USB_KeyboardReport_Data_t rep;
-				memset(&rep, 0, sizeof(USB_KeyboardReport_Data_t));
-
-				CreateKeyboardReport(&rep);
-
 				Endpoint_ClearSETUP();
 
-				// Write the report data to the control endpoint
-				Endpoint_Write_Control_Stream_LE(&rep, sizeof(USB_KeyboardReport_Data_t));
+				// Write the last report sent on the endpoint, typing only advances in HID_Task
+				Endpoint_Write_Control_Stream_LE(&sent, sizeof(USB_KeyboardReport_Data_t));
 				Endpoint_ClearOUT();
 			}
 
@@ -276,20 +490,26 @@ void k_EVENT_USB_Device_ControlRequest(void)
 }
 
 // Event handler for the USB device Start Of Frame event.
-void EVENT_USB_Device_StartOfFrame(void)
+void k_EVENT_USB_Device_StartOfFrame(void)
 {
 	++sof_cnt;
 	if (idle_cnt) --idle_cnt;
+	sched_sof();
 }
 
 int k_main(void)
 {
+	LoadSlot(getswi());
+	DDR(LED_PORT) |= _BV(LED_BIT);
+
+	sched_init();
+	sched_add(PSTR("hid"), HID_Task, SCHED_EV_SOF | SCHED_EV_TICK, 2);
+	sched_add(PSTR("chk"), Check_Task, SCHED_EV_TICK, 2);
+	sched_add(PSTR("totp"), TOTP_Task, SCHED_EV_TICK, 25);
+	sched_add(PSTR("wake"), Wake_Task, SCHED_EV_TICK | SCHED_EV_PIN, 2);
+
 	USB_Init();
 	sei();
 
-	while( 1 ) {
-		wdt_reset();
-		HID_Task();
-		USB_USBTask();
-	}
+	sched_run();
 }
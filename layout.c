@@ -0,0 +1,124 @@
+/**
+password typist
+
+@file		layout.c
+@brief		Keyboard layout tables, from printable ASCII to HID usage and modifiers.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+One entry per char 32..126, so a lookup is a single index whatever the char.
+Dead keys are the Windows ones; on hosts where the key isn't dead, the char
+comes out followed by a space.
+*/
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "layout.h"
+
+#define S	0x02		// left shift
+#define G	0x40		// altgr, right alt
+#define D	LAYOUT_DEAD
+
+static const uint8_t layouts[LAYOUT_COUNT][95][2] PROGMEM = {
+	{ // si
+		{0x2c, 0}, {0x1e, S}, {0x1f, S}, {0x20, S}, {0x21, S}, {0x22, S}, {0x23, S}, {0x2d, 0}, //   ! " # $ % & '
+		{0x25, S}, {0x26, S}, {0x2e, S}, {0x2e, 0}, {0x36, 0}, {0x38, 0}, {0x37, 0}, {0x24, S}, // ( ) * + , - . /
+		{0x27, 0}, {0x1e, 0}, {0x1f, 0}, {0x20, 0}, {0x21, 0}, {0x22, 0}, {0x23, 0}, {0x24, 0}, // 0 1 2 3 4 5 6 7
+		{0x25, 0}, {0x26, 0}, {0x37, S}, {0x36, S}, {0x36, G}, {0x27, S}, {0x37, G}, {0x2d, S}, // 8 9 : ; < = > ?
+		{0x19, G}, {0x04, S}, {0x05, S}, {0x06, S}, {0x07, S}, {0x08, S}, {0x09, S}, {0x0a, S}, // @ A B C D E F G
+		{0x0b, S}, {0x0c, S}, {0x0d, S}, {0x0e, S}, {0x0f, S}, {0x10, S}, {0x11, S}, {0x12, S}, // H I J K L M N O
+		{0x13, S}, {0x14, S}, {0x15, S}, {0x16, S}, {0x17, S}, {0x18, S}, {0x19, S}, {0x1a, S}, // P Q R S T U V W
+		{0x1b, S}, {0x1d, S}, {0x1c, S}, {0x09, G}, {0x14, G}, {0x0a, G}, {0x20, G|D}, {0x38, S}, // X Y Z [ \ ] ^ _
+		{0x24, G|D}, {0x04, 0}, {0x05, 0}, {0x06, 0}, {0x07, 0}, {0x08, 0}, {0x09, 0}, {0x0a, 0}, // ` a b c d e f g
+		{0x0b, 0}, {0x0c, 0}, {0x0d, 0}, {0x0e, 0}, {0x0f, 0}, {0x10, 0}, {0x11, 0}, {0x12, 0}, // h i j k l m n o
+		{0x13, 0}, {0x14, 0}, {0x15, 0}, {0x16, 0}, {0x17, 0}, {0x18, 0}, {0x19, 0}, {0x1a, 0}, // p q r s t u v w
+		{0x1b, 0}, {0x1d, 0}, {0x1c, 0}, {0x05, G}, {0x1a, G}, {0x11, G}, {0x1e, G|D}, // x y z { | } ~
+	},
+	{ // us
+		{0x2c, 0}, {0x1e, S}, {0x34, S}, {0x20, S}, {0x21, S}, {0x22, S}, {0x24, S}, {0x34, 0}, //   ! " # $ % & '
+		{0x26, S}, {0x27, S}, {0x25, S}, {0x2e, S}, {0x36, 0}, {0x2d, 0}, {0x37, 0}, {0x38, 0}, // ( ) * + , - . /
+		{0x27, 0}, {0x1e, 0}, {0x1f, 0}, {0x20, 0}, {0x21, 0}, {0x22, 0}, {0x23, 0}, {0x24, 0}, // 0 1 2 3 4 5 6 7
+		{0x25, 0}, {0x26, 0}, {0x33, S}, {0x33, 0}, {0x36, S}, {0x2e, 0}, {0x37, S}, {0x38, S}, // 8 9 : ; < = > ?
+		{0x1f, S}, {0x04, S}, {0x05, S}, {0x06, S}, {0x07, S}, {0x08, S}, {0x09, S}, {0x0a, S}, // @ A B C D E F G
+		{0x0b, S}, {0x0c, S}, {0x0d, S}, {0x0e, S}, {0x0f, S}, {0x10, S}, {0x11, S}, {0x12, S}, // H I J K L M N O
+		{0x13, S}, {0x14, S}, {0x15, S}, {0x16, S}, {0x17, S}, {0x18, S}, {0x19, S}, {0x1a, S}, // P Q R S T U V W
+		{0x1b, S}, {0x1c, S}, {0x1d, S}, {0x2f, 0}, {0x31, 0}, {0x30, 0}, {0x23, S}, {0x2d, S}, // X Y Z [ \ ] ^ _
+		{0x35, 0}, {0x04, 0}, {0x05, 0}, {0x06, 0}, {0x07, 0}, {0x08, 0}, {0x09, 0}, {0x0a, 0}, // ` a b c d e f g
+		{0x0b, 0}, {0x0c, 0}, {0x0d, 0}, {0x0e, 0}, {0x0f, 0}, {0x10, 0}, {0x11, 0}, {0x12, 0}, // h i j k l m n o
+		{0x13, 0}, {0x14, 0}, {0x15, 0}, {0x16, 0}, {0x17, 0}, {0x18, 0}, {0x19, 0}, {0x1a, 0}, // p q r s t u v w
+		{0x1b, 0}, {0x1c, 0}, {0x1d, 0}, {0x2f, S}, {0x31, S}, {0x30, S}, {0x35, S}, // x y z { | } ~
+	},
+	{ // de
+		{0x2c, 0}, {0x1e, S}, {0x1f, S}, {0x32, 0}, {0x21, S}, {0x22, S}, {0x23, S}, {0x32, S}, //   ! " # $ % & '
+		{0x25, S}, {0x26, S}, {0x30, S}, {0x30, 0}, {0x36, 0}, {0x38, 0}, {0x37, 0}, {0x24, S}, // ( ) * + , - . /
+		{0x27, 0}, {0x1e, 0}, {0x1f, 0}, {0x20, 0}, {0x21, 0}, {0x22, 0}, {0x23, 0}, {0x24, 0}, // 0 1 2 3 4 5 6 7
+		{0x25, 0}, {0x26, 0}, {0x37, S}, {0x36, S}, {0x64, 0}, {0x27, S}, {0x64, S}, {0x2d, S}, // 8 9 : ; < = > ?
+		{0x14, G}, {0x04, S}, {0x05, S}, {0x06, S}, {0x07, S}, {0x08, S}, {0x09, S}, {0x0a, S}, // @ A B C D E F G
+		{0x0b, S}, {0x0c, S}, {0x0d, S}, {0x0e, S}, {0x0f, S}, {0x10, S}, {0x11, S}, {0x12, S}, // H I J K L M N O
+		{0x13, S}, {0x14, S}, {0x15, S}, {0x16, S}, {0x17, S}, {0x18, S}, {0x19, S}, {0x1a, S}, // P Q R S T U V W
+		{0x1b, S}, {0x1d, S}, {0x1c, S}, {0x25, G}, {0x2d, G}, {0x26, G}, {0x35, D}, {0x38, S}, // X Y Z [ \ ] ^ _
+		{0x2e, S|D}, {0x04, 0}, {0x05, 0}, {0x06, 0}, {0x07, 0}, {0x08, 0}, {0x09, 0}, {0x0a, 0}, // ` a b c d e f g
+		{0x0b, 0}, {0x0c, 0}, {0x0d, 0}, {0x0e, 0}, {0x0f, 0}, {0x10, 0}, {0x11, 0}, {0x12, 0}, // h i j k l m n o
+		{0x13, 0}, {0x14, 0}, {0x15, 0}, {0x16, 0}, {0x17, 0}, {0x18, 0}, {0x19, 0}, {0x1a, 0}, // p q r s t u v w
+		{0x1b, 0}, {0x1d, 0}, {0x1c, 0}, {0x24, G}, {0x64, G}, {0x27, G}, {0x30, G}, // x y z { | } ~
+	},
+	{ // fr
+		{0x2c, 0}, {0x38, 0}, {0x20, 0}, {0x20, G}, {0x30, 0}, {0x34, S}, {0x1e, 0}, {0x21, 0}, //   ! " # $ % & '
+		{0x22, 0}, {0x2d, 0}, {0x32, 0}, {0x2e, S}, {0x10, 0}, {0x23, 0}, {0x36, S}, {0x37, S}, // ( ) * + , - . /
+		{0x27, S}, {0x1e, S}, {0x1f, S}, {0x20, S}, {0x21, S}, {0x22, S}, {0x23, S}, {0x24, S}, // 0 1 2 3 4 5 6 7
+		{0x25, S}, {0x26, S}, {0x37, 0}, {0x36, 0}, {0x64, 0}, {0x2e, 0}, {0x64, S}, {0x10, S}, // 8 9 : ; < = > ?
+		{0x27, G}, {0x14, S}, {0x05, S}, {0x06, S}, {0x07, S}, {0x08, S}, {0x09, S}, {0x0a, S}, // @ A B C D E F G
+		{0x0b, S}, {0x0c, S}, {0x0d, S}, {0x0e, S}, {0x0f, S}, {0x33, S}, {0x11, S}, {0x12, S}, // H I J K L M N O
+		{0x13, S}, {0x04, S}, {0x15, S}, {0x16, S}, {0x17, S}, {0x18, S}, {0x19, S}, {0x1d, S}, // P Q R S T U V W
+		{0x1b, S}, {0x1c, S}, {0x1a, S}, {0x22, G}, {0x25, G}, {0x2d, G}, {0x26, G}, {0x25, 0}, // X Y Z [ \ ] ^ _
+		{0x24, G|D}, {0x14, 0}, {0x05, 0}, {0x06, 0}, {0x07, 0}, {0x08, 0}, {0x09, 0}, {0x0a, 0}, // ` a b c d e f g
+		{0x0b, 0}, {0x0c, 0}, {0x0d, 0}, {0x0e, 0}, {0x0f, 0}, {0x33, 0}, {0x11, 0}, {0x12, 0}, // h i j k l m n o
+		{0x13, 0}, {0x04, 0}, {0x15, 0}, {0x16, 0}, {0x17, 0}, {0x18, 0}, {0x19, 0}, {0x1d, 0}, // p q r s t u v w
+		{0x1b, 0}, {0x1c, 0}, {0x1a, 0}, {0x21, G}, {0x23, G}, {0x2e, G}, {0x1f, G|D}, // x y z { | } ~
+	},
+};
+
+static const char names[] PROGMEM = "siusdefr";
+
+/**
+@brief Looks up how to type a char.
+@param[in]	l		Layout index
+@param[in]	c		Char
+@param[out]	ksc		HID usage
+@param[out]	mod		HID modifiers
+@return 0 if c can't be typed, 2 if it's a dead key that needs a space after it, 1 otherwise.
+*/
+uint8_t layout_c2ksc(const uint8_t l, const char c, uint8_t* ksc, uint8_t* mod)
+{
+	if( (c < 32) || (c > 126) || (l >= LAYOUT_COUNT) ) return 0;
+
+	const uint8_t* e = layouts[l][c - 32];
+	uint8_t f = pgm_read_byte(&e[1]);
+	*ksc = pgm_read_byte(&e[0]);
+	*mod = f & ~LAYOUT_DEAD;
+
+	return (f & LAYOUT_DEAD) ? 2 : 1;
+}
+
+/**
+@brief Finds a layout by its two letter name.
+@return Layout index or 0xff if not found.
+*/
+uint8_t layout_find(const char* name)
+{
+	uint8_t l;
+	for( l = 0; l < LAYOUT_COUNT; ++l ) {
+		if( (pgm_read_byte(&names[2*l]) == name[0]) && (pgm_read_byte(&names[2*l+1]) == name[1]) ) return l;
+	}
+
+	return 0xff;
+}
+
+/**
+@brief Returns the two letter name of a layout, in flash and not terminated. Unknown indexes are layout 0.
+*/
+const char* layout_name(const uint8_t l)
+{
+	return &names[(l < LAYOUT_COUNT) ? 2 * l : 0];
+}
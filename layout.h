@@ -0,0 +1,13 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <inttypes.h>
+
+#define LAYOUT_COUNT 4 // si, us, de, fr
+#define LAYOUT_DEAD 0x01 // flag: dead key, a space must follow to get the char itself
+
+uint8_t layout_c2ksc(const uint8_t l, const char c, uint8_t* ksc, uint8_t* mod);
+uint8_t layout_find(const char* name);
+const char* layout_name(const uint8_t l);
+
+#endif
@@ -11,36 +11,42 @@ password typist
 #include <avr/power.h>
 #include <util/delay.h>
 
+#include "sched.h"
+#include "rtc.h"
 #include "main.h"
-/*
-#define NSWITCHES 3
-static const uint8_t swbit[NSWITCHES] = {7, 6, 5};
-*/
-#define NSWITCHES 4
-static const uint8_t swbit[NSWITCHES] = {4, 5, 6, 7};
+static const uint8_t swbit[SW_COUNT] = SW_BITS;
+
+#define MODE_KEYBOARD 0
+#define MODE_SETUP 1
+#define MODE_PIPE 2
+
+static uint8_t mode = MODE_KEYBOARD;
+
+// read current dip switch selection, pull-ups are on after the first getswi
+uint8_t readswi(void)
+{
+	uint8_t i, r = 0;
 
-#define SW_ERASE_CMD 15
-#define SW_SETUP_CMD 0
+	for( i = 0; i < SW_COUNT; ++i ) {
+		if( !(PIN(SW_PORT) & _BV(swbit[i])) ) r |= _BV(i);
+	}
 
-static uint8_t s_mode = 0;
+	return r;
+}
 
-// get dip switch selection
+// get dip switch selection at boot
 uint8_t getswi(void)
 {
 	static uint8_t r = 255;
 
 	if( r == 255 ) {
 		uint8_t i;
-		for( i = 0; i < NSWITCHES; ++i ) {
+		for( i = 0; i < SW_COUNT; ++i ) {
 			SW_PORT |= _BV(swbit[i]);
 		}
 
 		_delay_ms(1);
-		r = 0;
-
-		for( i = 0; i < NSWITCHES; ++i ) {
-			if( !(PIN(SW_PORT) & _BV(swbit[i])) ) r |= _BV(i);
-		}
+		r = readswi();
 	}
 
 	return r;
@@ -52,27 +58,42 @@ void eeprom_erase(void)
 	uint16_t ea;
 
 	for( ea = 0; ea <= E2END; ++ea ) {
-		wdt_reset();
+		sched_feed();
 		eeprom_update_byte((void*)ea, 0);
 	}
 }
 
 int main(void)
 {
+	// watchdog stays enabled after a watchdog reset
+	uint8_t rst = MCUSR;
+	MCUSR = 0;
+	wdt_disable();
+
 	clock_prescale_set(clock_div_1);
 
+	sched_trap_save();
+	rtc_init(rst & _BV(WDRF)); // time set in setup mode is kept when switching to a slot
+
 	if( getswi() == SW_ERASE_CMD ) {
-		DDR(LED_PORT) |= _BV(LED_BIT);
-		LED_PORT |= _BV(LED_BIT);
-		eeprom_erase();
-		_delay_ms(500);
-		LED_PORT &= ~_BV(LED_BIT);
+		// only on powerup, not after a watchdog reset with the switches moved there since
+		if( !(rst & _BV(WDRF)) ) {
+			DDR(LED_PORT) |= _BV(LED_BIT);
+			LED_PORT |= _BV(LED_BIT);
+			eeprom_erase();
+			_delay_ms(500);
+			LED_PORT &= ~_BV(LED_BIT);
+		}
 	} else
 	if( getswi() == SW_SETUP_CMD ) {
-		s_mode = 1;
+		mode = MODE_SETUP;
 		s_main();
+	} else
+	if( getswi() == SW_PIPE_CMD ) {
+		mode = MODE_PIPE;
+		p_main();
 	} else {
-		s_mode = 0;
+		mode = MODE_KEYBOARD;
 		k_main();
 	}
 
@@ -83,8 +104,11 @@ int main(void)
 
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue, const uint16_t wIndex, const void** const DescriptorAddress)
 {
-	if( s_mode ) {
+	if( mode == MODE_SETUP ) {
 		return s_CALLBACK_USB_GetDescriptor(wValue, wIndex, DescriptorAddress);
+	} else
+	if( mode == MODE_PIPE ) {
+		return p_CALLBACK_USB_GetDescriptor(wValue, wIndex, DescriptorAddress);
 	} else {
 		return k_CALLBACK_USB_GetDescriptor(wValue, wIndex, DescriptorAddress);
 	}
@@ -92,8 +116,11 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue, const uint16_t wIndex
 
 void EVENT_USB_Device_ConfigurationChanged(void)
 {
-	if( s_mode ) {
+	if( mode == MODE_SETUP ) {
 		s_EVENT_USB_Device_ConfigurationChanged();
+	} else
+	if( mode == MODE_PIPE ) {
+		p_EVENT_USB_Device_ConfigurationChanged();
 	} else {
 		k_EVENT_USB_Device_ConfigurationChanged();
 	}
@@ -101,9 +128,36 @@ void EVENT_USB_Device_ConfigurationChanged(void)
 
 void EVENT_USB_Device_ControlRequest(void)
 {
-	if( s_mode ) {
+	if( mode == MODE_SETUP ) {
 		s_EVENT_USB_Device_ControlRequest();
+	} else
+	if( mode == MODE_PIPE ) {
+		p_EVENT_USB_Device_ControlRequest();
 	} else {
 		k_EVENT_USB_Device_ControlRequest();
 	}
 }
+
+// The typing personalities sleep while the host is suspended, setup mode keeps
+// running, its entropy collection borrows the watchdog that ticks then.
+void EVENT_USB_Device_Suspend(void)
+{
+	if( mode != MODE_SETUP ) sched_suspend(1);
+}
+
+void EVENT_USB_Device_WakeUp(void)
+{
+	if( mode != MODE_SETUP ) sched_suspend(0);
+}
+
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	if( mode == MODE_SETUP ) {
+		sched_sof();
+	} else
+	if( mode == MODE_PIPE ) {
+		p_EVENT_USB_Device_StartOfFrame();
+	} else {
+		k_EVENT_USB_Device_StartOfFrame();
+	}
+}
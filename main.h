@@ -1,28 +1,92 @@
 #ifndef MAIN_H
 #define MAIN_H
 
-#define PWD_SIZE 32
-#define PWD_COUNT 16
+#include "Config/AppConfig.h"
 
-#define SW_PORT PORTD
+// slot bytecode, printable chars 32..126 are typed as they are
+#define OP_END		0x00	// end of slot, also the erased state
+#define OP_KEY		0x01	// followed by a HID usage, pressed without modifiers
+#define OP_CHORD	0x02	// followed by a modifier mask and a HID usage
+#define OP_TOTP		0x03	// followed by key length and key, types the current TOTP code
+#define OP_LAYOUT	0x04	// followed by a layout index, used for the rest of the slot
+#define OP_TEST		0x05	// followed by a char count (low byte first) and a key period in frames, types the test pattern
+#define OP_TAB		0x09	// tab key
+#define OP_ENTER	0x0d	// enter key
+#define OP_DELAY	0x80	// OR-ed with n = 1..127, waits n * 8 USB frames
+
+// Test pattern: blocks of 30 chars. Block b starts with b in TEST_MARK base 30 digits, low
+// first, then char j of the block is TEST_CHARS[j]. The digits make each position unique over
+// the 65535 chars a count allows, so a burst of dropped chars is told apart from a shorter one.
+// The chars are on the same keys in every layout, so tools/pwcheck.cpp can place each char it
+// gets in the pattern from key codes alone.
+#define TEST_CHARS "0123456789bcdefghijklnoprstuvx"
+#define TEST_MARK 3
+
+// slot 0 holds device settings, stored as they are
+#define META_LAYOUT 0 // eeprom address of keyboard layout index
+#define META_CAPS 1 // eeprom address of caps lock handling, CAPS_*
+#define META_CRC 2 // eeprom address of slot 1's CRC-8, the other slots' follow (slot.c)
+
+#if META_CRC + PWD_COUNT - 1 > PWD_SIZE
+#error slot 0 too small for the slot CRCs
+#endif
+
+// caps lock handling, when it's on as typing starts
+#define CAPS_SHIFT	0	// letters are typed with shift inverted
+#define CAPS_TAP	1	// caps lock is tapped off for the slot and on again after it
 
+// LED report channel: each scroll lock edge clocks in a symbol, num lock is bit 0, caps lock bit 1.
+// A frame is the marker 3 0 3, the slot's high and low symbols and a check symbol ~(hi ^ lo) & 3.
+// Slot 0 retypes the current slot, others are loaded and typed.
+#define LEDSEL_TIMEOUT	500	// USB frames between symbols before the decoder starts over
+#define LEDSEL_SETTLE	100	// USB frames from the last symbol to typing, for the host to restore its LEDs
+
+// pin map of the board the makefile builds for (HW=...), switch n is bit n of the address
+#if defined(HW_BEETLE)
+// DFRobot Beetle, atmega32u4: switches on D11, D10 and D9, the on-board LED on D13
+#define SW_PORT PORTB
+#define SW_COUNT 3
+#define SW_BITS {7, 6, 5}
+#define SW_MASK 0xe0 // dip switch bits in SW_PORT
+#define LED_PORT PORTC
+#define LED_BIT 7
+#else
+// password typist board, atmega32u2
+#define SW_PORT PORTD
+#define SW_COUNT 4
+#define SW_BITS {4, 5, 6, 7}
+#define SW_MASK 0xf0
 #define LED_PORT PORTD
 #define LED_BIT 1
+#endif
+
+// dip switch addresses that aren't slots, 14 and 15 with four switches
+#define SW_SETUP_CMD 0
+#define SW_ERASE_CMD ((1 << SW_COUNT) - 1)
+#define SW_PIPE_CMD (SW_ERASE_CMD - 1)
 
 #define DDR(x) (*(&x - 1))
 #define PIN(x) (*(&x - 2))
 
 uint8_t getswi(void);
+uint8_t readswi(void);
 void eeprom_erase(void);
 
 int k_main(void);
 uint16_t k_CALLBACK_USB_GetDescriptor(const uint16_t, const uint16_t, const void** const);
 void k_EVENT_USB_Device_ConfigurationChanged(void);
 void k_EVENT_USB_Device_ControlRequest(void);
+void k_EVENT_USB_Device_StartOfFrame(void);
 
 int s_main(void);
 uint16_t s_CALLBACK_USB_GetDescriptor(const uint16_t, const uint16_t, const void** const);
 void s_EVENT_USB_Device_ConfigurationChanged(void);
 void s_EVENT_USB_Device_ControlRequest(void);
 
+int p_main(void);
+uint16_t p_CALLBACK_USB_GetDescriptor(const uint16_t, const uint16_t, const void** const);
+void p_EVENT_USB_Device_ConfigurationChanged(void);
+void p_EVENT_USB_Device_ControlRequest(void);
+void p_EVENT_USB_Device_StartOfFrame(void);
+
 #endif
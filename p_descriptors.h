@@ -0,0 +1,73 @@
+#ifndef _P_DESCRIPTORS_H_
+#define _P_DESCRIPTORS_H_
+
+#include <LUFA/Drivers/USB/USB.h>
+
+#include <avr/pgmspace.h>
+
+#include "Config/AppConfig.h" // endpoint sizes
+
+/* Type define for the device configuration descriptor structure. This must be defined in the
+	application code, as the configuration descriptor contains several sub-descriptors which
+	vary between devices, and which describe the device's usage to the host. */
+typedef struct
+{
+	USB_Descriptor_Configuration_Header_t    Config;
+
+	// Keyboard HID Interface
+	USB_Descriptor_Interface_t               HID_Interface;
+	USB_HID_Descriptor_HID_t                 HID_KeyboardHID;
+	USB_Descriptor_Endpoint_t                HID_ReportINEndpoint;
+
+	// CDC Interface Association, groups the two CDC interfaces into one function
+	USB_Descriptor_Interface_Association_t   CDC_IAD;
+
+	// CDC Control Interface
+	USB_Descriptor_Interface_t               CDC_CCI_Interface;
+	USB_CDC_Descriptor_FunctionalHeader_t    CDC_Functional_Header;
+	USB_CDC_Descriptor_FunctionalACM_t       CDC_Functional_ACM;
+	USB_CDC_Descriptor_FunctionalUnion_t     CDC_Functional_Union;
+	USB_Descriptor_Endpoint_t                CDC_NotificationEndpoint;
+
+	// CDC Data Interface
+	USB_Descriptor_Interface_t               CDC_DCI_Interface;
+	USB_Descriptor_Endpoint_t                CDC_DataOutEndpoint;
+	USB_Descriptor_Endpoint_t                CDC_DataInEndpoint;
+} USB_Descriptor_Configuration_t;
+
+/* Enum for the device interface descriptor IDs within the device. Each interface descriptor
+	should have a unique ID index associated with it, which can be used to refer to the
+	interface from other descriptors. */
+enum InterfaceDescriptors_t
+{
+	INTERFACE_ID_Keyboard = 0, // Keyboard interface descriptor ID
+	INTERFACE_ID_CDC_CCI  = 1, // CDC CCI interface descriptor ID
+	INTERFACE_ID_CDC_DCI  = 2, // CDC DCI interface descriptor ID
+};
+
+/* Enum for the device string descriptor IDs within the device. Each string descriptor should
+	have a unique ID index associated with it, which can be used to refer to the string from
+	other descriptors. */
+enum StringDescriptors_t
+{
+	STRING_ID_Language     = 0,
+	STRING_ID_Manufacturer = 1,
+	STRING_ID_Product      = 2,
+};
+
+// The atmega32u2 has endpoints 1..4 only, so the keyboard has no OUT endpoint and
+// LED reports come as SET_REPORT requests on the control endpoint.
+
+// Endpoint address of the Keyboard HID reporting IN endpoint.
+#define KEYBOARD_IN_EPADDR             (ENDPOINT_DIR_IN  | 1)
+
+// Endpoint address of the CDC device-to-host notification IN endpoint.
+#define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 2)
+
+// Endpoint address of the CDC device-to-host data IN endpoint.
+#define CDC_TX_EPADDR                  (ENDPOINT_DIR_IN  | 3)
+
+// Endpoint address of the CDC host-to-device data OUT endpoint.
+#define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
+
+#endif
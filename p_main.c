@@ -0,0 +1,327 @@
+/**
+password typist
+
+@file		p_main.c
+@brief		Typing pipe personality: text received on the CDC interface is typed on the keyboard interface.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Bytes are typed in the device layout like slot text, tab and line ends as their
+keys (\r\n counts once). Keys follow each other in consecutive reports, one per
+frame, with a release only when the same key repeats. The CDC line speed sets
+the typing rate, as if the keystrokes were bits on a serial line (bps / 10 chars
+per second); 0 or 10000 and above is one key per poll. The keyboard endpoint is
+double banked and both banks are kept filled, so a poll finds a key waiting even
+when the task misses a frame. The receive ring takes
+a packet only when it fits, so the host is NAKed and nothing is dropped.
+*/
+
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "p_descriptors.h"
+#include "circbuf8.h"
+#include "sched.h"
+#include "layout.h"
+#include "main.h"
+
+#include <LUFA/Drivers/USB/USB.h>
+
+extern uint8_t rxbuf[SER_RING_SIZE]; // s_main.c's, only one personality runs
+static volatile struct cbuf8_t pipe_rxq;
+
+static CDC_LineEncoding_t LineEncoding = {
+	.BaudRateBPS = 0,
+	.CharFormat  = CDC_LINEENCODING_OneStopBit,
+	.ParityType  = CDC_PARITY_None,
+	.DataBits    = 8
+};
+
+// set from the USB interrupts, as in k_main.c
+static bool UsingReportProtocol = true;
+static volatile uint16_t idle_rate = 500;
+static volatile uint16_t idle_cnt = 0;
+static volatile uint16_t sof_cnt = 0;
+static USB_KeyboardReport_Data_t sent; // last report on the endpoint, GET_REPORT returns it
+
+static uint8_t layout = 0;
+static volatile uint8_t leds = 0; // host's lock key LEDs, from SET_REPORT
+
+// sof_cnt in one piece, the SOF interrupt may come between its bytes
+static uint16_t SofCount(void)
+{
+	uint8_t g = SREG;
+	cli();
+	uint16_t n = sof_cnt;
+	SREG = g;
+	return n;
+}
+
+// frames per typed char at the current line speed
+static uint16_t CharFrames(void)
+{
+	uint8_t g = SREG;
+	cli();
+	uint32_t bps = LineEncoding.BaudRateBPS; // SET_LINE_CODING writes it from the interrupt
+	SREG = g;
+	return (bps && (bps < 10000)) ? 10000 / bps : 1;
+}
+
+// Fills rep with the next key from the pipe. A key down in the last report is
+// released implicitly by the next one, unless the next one is the same key.
+static void CreateKeyboardReport(USB_KeyboardReport_Data_t* const rep)
+{
+	static uint8_t last = 0; // key in the last report
+	static uint8_t next = 0; // key waiting for the release of the same key
+	static uint8_t next_mod;
+	static uint8_t space = 0; // dead key typed, space follows
+	static uint8_t cr = 0; // last byte was \r
+	static uint16_t t; // sof_cnt at last key
+
+	uint16_t f = CharFrames();
+	if( !next && ((f == 1) || ((uint16_t)(SofCount() - t) >= f)) ) { // at full rate the host's polls pace the keys
+		uint8_t c;
+		if( space ) {
+			space = 0;
+			next = HID_KEYBOARD_SC_SPACE;
+			next_mod = 0;
+		} else
+		while( cbuf8_get(&pipe_rxq, &c) ) {
+			next_mod = 0;
+			if( (c == '\n') && cr ) { cr = 0; continue; } // second half of \r\n
+			cr = (c == '\r');
+
+			if( (c == '\r') || (c == '\n') ) { next = HID_KEYBOARD_SC_ENTER; } else
+			if( c == '\t' ) { next = HID_KEYBOARD_SC_TAB; } else {
+				uint8_t r = layout_c2ksc(layout, c, &next, &next_mod);
+				if( !r ) continue; // skip what can't be typed
+				space = (r == 2);
+				if( (leds & HID_KEYBOARD_LED_CAPSLOCK) && ((c | 0x20) >= 'a') && ((c | 0x20) <= 'z') ) {
+					next_mod ^= HID_KEYBOARD_MODIFIER_LEFTSHIFT; // caps lock would invert the case
+				}
+			}
+			break;
+		}
+	}
+
+	if( !next || (next == last) ) { // nothing to type, or the same key must be released first
+		last = 0;
+		return;
+	}
+
+	rep->Modifier = next_mod;
+	rep->KeyCode[0] = next;
+	last = next;
+	next = 0;
+	t = SofCount();
+}
+
+// Sends the next HID report to the host, via the keyboard data endpoint.
+static void SendNextReport(void)
+{
+	Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
+
+	// fill every free bank, so the next report is already waiting when the host takes one
+	while( Endpoint_IsReadWriteAllowed() ) {
+		USB_KeyboardReport_Data_t rep;
+		memset(&rep, 0, sizeof(USB_KeyboardReport_Data_t));
+		CreateKeyboardReport(&rep);
+
+		uint8_t g = SREG;
+		cli();
+		if( (0 == memcmp(&sent, &rep, sizeof(USB_KeyboardReport_Data_t))) && idle_cnt ) {
+			SREG = g;
+			return;
+		}
+		idle_cnt = idle_rate;
+		memcpy(&sent, &rep, sizeof(USB_KeyboardReport_Data_t));
+		SREG = g;
+
+		Endpoint_Write_Stream_LE(&rep, sizeof(USB_KeyboardReport_Data_t), NULL);
+		Endpoint_ClearIN();
+	}
+}
+
+// Moves received CDC packets into the ring, leaving them in the endpoint (host is NAKed) until they fit.
+static void ReceivePipe(void)
+{
+	Endpoint_SelectEndpoint(CDC_RX_EPADDR);
+	if( Endpoint_IsOUTReceived() && (pipe_rxq.size - pipe_rxq.len >= CDC_TXRX_EPSIZE) ) {
+		uint8_t d = Endpoint_BytesInEndpoint();
+		while( d-- ) cbuf8_put(&pipe_rxq, Endpoint_Read_8());
+		Endpoint_ClearOUT();
+	}
+}
+
+void Pipe_Task(void)
+{
+	if (USB_DeviceState != DEVICE_STATE_Configured) return;
+
+	ReceivePipe();
+	SendNextReport();
+}
+
+/* Event handler for the USB_ConfigurationChanged event. This is fired when the host sets the current configuration
+	of the USB device after enumeration, and configures the keyboard and CDC endpoints. */
+void p_EVENT_USB_Device_ConfigurationChanged(void)
+{
+	bool ConfigSuccess = true;
+
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR, EP_TYPE_INTERRUPT, KEYBOARD_EPSIZE, 2); // double banked
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(CDC_NOTIFICATION_EPADDR, EP_TYPE_INTERRUPT, CDC_NOTIFICATION_EPSIZE, 1);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(CDC_TX_EPADDR, EP_TYPE_BULK, CDC_TXRX_EPSIZE, 1);
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(CDC_RX_EPADDR, EP_TYPE_BULK, CDC_TXRX_EPSIZE, 1);
+
+	LineEncoding.BaudRateBPS = 0;
+
+	// Turn on Start-of-Frame events for the report period and polling the pipe
+	USB_Device_EnableSOFEvents();
+}
+
+// HID class requests to the keyboard interface, as in k_main.c.
+static void HID_ControlRequest(void)
+{
+	switch (USB_ControlRequest.bRequest)
+	{
+		case HID_REQ_GetReport:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&sent, sizeof(USB_KeyboardReport_Data_t));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case HID_REQ_SetReport:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+
+				// Wait until the LED report has been sent by the host
+				while (!(Endpoint_IsOUTReceived()))
+				{
+					if (USB_DeviceState == DEVICE_STATE_Unattached)
+					  return;
+				}
+
+				leds = Endpoint_Read_8();
+
+				Endpoint_ClearOUT();
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case HID_REQ_GetProtocol:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_8(UsingReportProtocol);
+				Endpoint_ClearIN();
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+		case HID_REQ_SetProtocol:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_ClearStatusStage();
+				UsingReportProtocol = (USB_ControlRequest.wValue != 0);
+			}
+
+			break;
+		case HID_REQ_SetIdle:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_ClearStatusStage();
+				idle_rate = ((USB_ControlRequest.wValue & 0xFF00) >> 6);
+			}
+
+			break;
+		case HID_REQ_GetIdle:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_8(idle_rate >> 2);
+				Endpoint_ClearIN();
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+	}
+}
+
+// CDC class requests to the control interface, as in s_main.c.
+static void CDC_ControlRequest(void)
+{
+	switch (USB_ControlRequest.bRequest)
+	{
+		case CDC_REQ_GetLineEncoding:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(&LineEncoding, sizeof(CDC_LineEncoding_t));
+				Endpoint_ClearOUT();
+			}
+
+			break;
+		case CDC_REQ_SetLineEncoding:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_Read_Control_Stream_LE(&LineEncoding, sizeof(CDC_LineEncoding_t));
+				Endpoint_ClearIN();
+			}
+
+			break;
+		case CDC_REQ_SetControlLineState:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Endpoint_ClearSETUP();
+				Endpoint_ClearStatusStage();
+			}
+
+			break;
+	}
+}
+
+/* Event handler for the USB_ControlRequest event. Class requests are passed to the
+	handler of the interface they address, by the interface number in wIndex. */
+void p_EVENT_USB_Device_ControlRequest(void)
+{
+	if( (USB_ControlRequest.wIndex & 0xff) == INTERFACE_ID_Keyboard ) {
+		HID_ControlRequest();
+	} else {
+		CDC_ControlRequest();
+	}
+}
+
+// Event handler for the USB device Start Of Frame event.
+void p_EVENT_USB_Device_StartOfFrame(void)
+{
+	++sof_cnt;
+	if (idle_cnt) --idle_cnt;
+	sched_sof();
+}
+
+// Reads settings, for p_main and the host emulator.
+void p_Init(void)
+{
+	cbuf8_clear(&pipe_rxq, rxbuf, sizeof(rxbuf));
+	layout = eeprom_read_byte((void*)META_LAYOUT);
+	if( layout >= LAYOUT_COUNT ) { layout = 0; } // never set
+}
+
+int p_main(void)
+{
+	p_Init();
+
+	sched_init();
+	sched_add(PSTR("pipe"), Pipe_Task, SCHED_EV_SOF | SCHED_EV_TICK, 2);
+
+	USB_Init();
+	sei();
+
+	sched_run();
+}
@@ -0,0 +1,123 @@
+/**
+password typist
+
+@file		prov.c
+@brief		Slot storage over HID feature reports, for provisioning through hidraw without a serial driver.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Feature report n holds a status byte and the plaintext of slots n and n+1;
+report 15 has slot 15 only, the rest is zeros on reading and ignored on
+writing. The status flags a slot whose stored bytes fail their CRC, as L?
+does. GET_REPORT reads the slots straight from the control request, which
+is served in the USB interrupt. SET_REPORT is taken into a buffer and
+acknowledged, and Prov_Task stores it with the slot code ser.c uses, as there's
+no time in the interrupt for eeprom writes. Until it's stored every GET_REPORT
+answers with PROV_BUSY and no slots, and a SET_REPORT that comes meanwhile is
+dropped, so the host reads the report back until it's no longer busy and
+compares it with what it wrote. GET_REPORT answers PROV_BUSY as well while
+ser.c writes or erases slots, which the interrupt may have cut into, rather
+than flag the half written ones as bad. Nothing is stalled. Read slots are wiped from
+the stack once sent.
+*/
+
+#include <string.h>
+#include <avr/io.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+
+#include "prov.h"
+#include "slot.h"
+#include "sched.h"
+
+#define HID_REPORT_TYPE_FEATURE 3 // high byte of wValue in GET_REPORT and SET_REPORT
+
+static uint8_t pbuf[1 + PROV_REPORT_SIZE]; // SET_REPORT being stored: report id, which is the first slot, status and the slots
+static volatile uint8_t busy = 0; // pbuf belongs to Prov_Task until it's stored
+
+// Fills report r with slots n and n+1, or just PROV_BUSY while a SET_REPORT or ser.c is storing slots. From the USB interrupt.
+static void Prov_Read(const uint8_t n, uint8_t* r)
+{
+	memset(r, 0, 1 + PROV_REPORT_SIZE);
+	r[0] = n;
+	if( busy || slot_locked() ) {
+		r[1] = PROV_BUSY;
+		return;
+	}
+
+	// an eeprom access of the main context this interrupt cut into finds the registers as it left them
+	uint16_t ar = EEAR;
+	uint8_t dr = EEDR;
+
+	uint8_t i;
+	for( i = 0; (i < PROV_SLOTS) && (n + i < PWD_COUNT); ++i ) {
+		slot_read(n + i, r + 2 + i * PWD_SIZE);
+		if( !slot_check(n + i) ) { r[1] |= PROV_BAD(i); }
+	}
+
+	EEAR = ar;
+	EEDR = dr;
+}
+
+/**
+@brief Handles the requests to the provisioning interface, from the USB interrupt. Unhandled ones are stalled.
+*/
+void Prov_ControlRequest(void)
+{
+	uint8_t n = USB_ControlRequest.wValue & 0xff;
+	if( ((USB_ControlRequest.wValue >> 8) != HID_REPORT_TYPE_FEATURE) || (n == 0) || (n >= PWD_COUNT) ) return;
+
+	uint8_t r[1 + PROV_REPORT_SIZE];
+
+	switch (USB_ControlRequest.bRequest)
+	{
+		case HID_REQ_GetReport:
+			if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
+			{
+				Prov_Read(n, r);
+
+				Endpoint_ClearSETUP();
+				Endpoint_Write_Control_Stream_LE(r, sizeof(r));
+				Endpoint_ClearOUT();
+
+				memset(r, 0, sizeof(r));
+			}
+
+			break;
+		case HID_REQ_SetReport:
+			if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+				&& (USB_ControlRequest.wLength == sizeof(pbuf)))
+			{
+				Endpoint_ClearSETUP();
+				if( busy ) { // the previous one isn't stored yet, this one is dropped
+					Endpoint_Read_Control_Stream_LE(r, sizeof(r));
+					memset(r, 0, sizeof(r));
+				} else {
+					Endpoint_Read_Control_Stream_LE(pbuf, sizeof(pbuf));
+					pbuf[0] = n;
+					busy = 1;
+					sched_post(SCHED_EV_EP);
+				}
+				Endpoint_ClearIN();
+			}
+
+			break;
+	}
+}
+
+/**
+@brief Stores the slots of a SET_REPORT.
+*/
+void Prov_Task(void)
+{
+	if( !busy ) return;
+
+	uint8_t i, n = pbuf[0];
+	for( i = 0; (i < PROV_SLOTS) && (n + i < PWD_COUNT); ++i ) {
+		slot_write(n + i, pbuf + 2 + i * PWD_SIZE);
+		sched_feed(); // a slot can take the whole deadline
+	}
+
+	memset(pbuf, 0, sizeof(pbuf));
+	busy = 0;
+}
@@ -0,0 +1,15 @@
+#ifndef PROV_H
+#define PROV_H
+
+#include <inttypes.h>
+
+#include "main.h"
+
+// status byte of a feature report, after the report id
+#define PROV_BUSY	0x80	// a SET_REPORT or a serial command is storing slots, the slots are not sent
+#define PROV_BAD(i)	_BV(i)	// slot n+i fails its CRC check (slot_check), its bytes are sent as read
+
+void Prov_ControlRequest(void);
+void Prov_Task(void);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+password typist
+
+@file		rng.c
+@brief		Random bytes from watchdog oscillator jitter, conditioned with SHA-1.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+The watchdog runs from its own 128 kHz RC oscillator. Each sample is timer0
+and timer1, both clocked from the crystal, read in the watchdog interrupt.
+Drift and jitter of the RC oscillator make up the entropy.
+*/
+
+#include <avr/io.h>
+
+#include "sched.h"
+#include "sha1.h"
+#include "rng.h"
+
+static volatile uint8_t smp[2];
+static volatile uint8_t nsmp;
+
+static uint8_t seed[SHA1_HASH];
+static uint8_t out[SHA1_HASH];
+static uint8_t outlen = 0;
+static uint8_t ctr = 0;
+
+// watchdog interrupt
+static void rng_sample(void)
+{
+	smp[0] = TCNT0;
+	smp[1] = TCNT1L;
+	++nsmp;
+}
+
+/**
+@brief Hashes RNG_SAMPLES new samples into the seed, takes about a second.
+@param[out]	hist	If not NULL, 16 bins counting the low nibble of timer0 samples, to judge the source
+@return Collection time in ms.
+*/
+uint16_t rng_seed(uint16_t* hist)
+{
+	struct sha1_t s;
+	sha1_init(&s);
+	sha1_update(&s, seed, SHA1_HASH);
+
+	uint32_t dur = 0;
+	uint16_t t = sched_now();
+
+	nsmp = 0;
+	sched_wdt_hook(rng_sample);
+	uint8_t i;
+	for( i = 0; i < RNG_SAMPLES; ++i ) {
+		while( nsmp == i );
+		uint8_t b[2] = {smp[0], smp[1]};
+		sched_feed(); // also restarts the watchdog period, so every sample is one whole period
+		sha1_update(&s, b, sizeof(b));
+		if( hist ) ++hist[b[0] & 0x0f];
+
+		uint16_t now = sched_now();
+		dur += (uint16_t)(now - t);
+		t = now;
+	}
+	sched_wdt_hook(NULL);
+
+	sha1_final(&s, seed);
+	outlen = 0;
+
+	return dur / (F_CPU / 64 / 1000); // timer0 counts per ms
+}
+
+/**
+@brief Returns a random byte, SHA-1 of the seed and a counter.
+*/
+uint8_t rng_byte(void)
+{
+	if( outlen == 0 ) {
+		struct sha1_t s;
+		sha1_init(&s);
+		sha1_update(&s, seed, SHA1_HASH);
+		sha1_update(&s, &ctr, 1);
+		sha1_final(&s, out);
+		++ctr;
+		outlen = SHA1_HASH;
+	}
+
+	return out[--outlen];
+}
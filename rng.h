@@ -0,0 +1,11 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <inttypes.h>
+
+#define RNG_SAMPLES 64 // watchdog periods of about 16 ms hashed into each seed
+
+uint16_t rng_seed(uint16_t* hist);
+uint8_t rng_byte(void);
+
+#endif
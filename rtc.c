@@ -0,0 +1,72 @@
+/**
+password typist
+
+@file		rtc.c
+@brief		Seconds clock from the crystal through timer1, kept over watchdog resets.
+@author		Matej Kogovsek
+@copyright	GPL v2
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "rtc.h"
+
+#define RTC_PRESCALE 256
+
+// unix time, survives watchdog reset, valid while chk == ~t
+static volatile uint32_t rtc_t __attribute__((section(".noinit")));
+static volatile uint32_t rtc_chk __attribute__((section(".noinit")));
+
+// timer1 compare match, once per second
+ISR(TIMER1_COMPA_vect)
+{
+	uint32_t t = rtc_t + 1;
+	rtc_t = t;
+	rtc_chk = ~t;
+}
+
+/**
+@brief Starts timer1 in CTC mode at 1 Hz.
+@param[in]	keep		Keep time from before reset, false after power on
+*/
+void rtc_init(const uint8_t keep)
+{
+	if( !keep ) { rtc_chk = rtc_t; } // invalid
+
+	TCCR1A = 0;
+	TCCR1B = _BV(WGM12) | _BV(CS12);
+	OCR1A = F_CPU / RTC_PRESCALE - 1;
+	TCNT1 = 0;
+	TIMSK1 = _BV(OCIE1A);
+}
+
+/**
+@brief Sets time. Interrupt safe.
+@param[in]	t		Unix time
+*/
+void rtc_set(const uint32_t t)
+{
+	uint8_t g = SREG;
+	cli();
+	TCNT1 = 0;
+	rtc_t = t;
+	rtc_chk = ~t;
+	SREG = g;
+}
+
+/**
+@brief Gets time. Interrupt safe.
+@param[out]	t		Unix time
+@return True if time was set since power on, false otherwise.
+*/
+uint8_t rtc_get(uint32_t* t)
+{
+	uint8_t g = SREG;
+	cli();
+	*t = rtc_t;
+	uint8_t r = (rtc_chk == ~*t);
+	SREG = g;
+
+	return r;
+}
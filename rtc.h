@@ -0,0 +1,10 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <inttypes.h>
+
+void rtc_init(const uint8_t keep);
+void rtc_set(const uint32_t t);
+uint8_t rtc_get(uint32_t* t);
+
+#endif
@@ -1,19 +1,82 @@
 #include "s_descriptors.h"
+#include "prov.h"
+
+// A feature report of PROV_REPORT_SIZE bytes per id, id n holds a status byte and slots n and n+1 (prov.c)
+#define PROV_FEATURE(n) \
+	HID_RI_REPORT_ID(8, n), \
+	HID_RI_USAGE(8, 0x01), \
+	HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE | HID_IOF_NON_VOLATILE)
+
+const USB_Descriptor_HIDReport_Datatype_t PROGMEM s_ProvReport[] =
+{
+	HID_RI_USAGE_PAGE(16, 0xFF00), // Vendor Defined
+	HID_RI_USAGE(8, 0x01),
+	HID_RI_COLLECTION(8, 0x01), // Application
+	HID_RI_LOGICAL_MINIMUM(8, 0x00),
+	HID_RI_LOGICAL_MAXIMUM(16, 0x00FF),
+	HID_RI_REPORT_SIZE(8, 0x08),
+	HID_RI_REPORT_COUNT(8, PROV_REPORT_SIZE),
+	// ids 1..PWD_COUNT-1, as Prov_ControlRequest takes them
+	PROV_FEATURE(1),
+#if PWD_COUNT > 2
+	PROV_FEATURE(2),
+#endif
+#if PWD_COUNT > 3
+	PROV_FEATURE(3),
+#endif
+#if PWD_COUNT > 4
+	PROV_FEATURE(4),
+#endif
+#if PWD_COUNT > 5
+	PROV_FEATURE(5),
+#endif
+#if PWD_COUNT > 6
+	PROV_FEATURE(6),
+#endif
+#if PWD_COUNT > 7
+	PROV_FEATURE(7),
+#endif
+#if PWD_COUNT > 8
+	PROV_FEATURE(8),
+#endif
+#if PWD_COUNT > 9
+	PROV_FEATURE(9),
+#endif
+#if PWD_COUNT > 10
+	PROV_FEATURE(10),
+#endif
+#if PWD_COUNT > 11
+	PROV_FEATURE(11),
+#endif
+#if PWD_COUNT > 12
+	PROV_FEATURE(12),
+#endif
+#if PWD_COUNT > 13
+	PROV_FEATURE(13),
+#endif
+#if PWD_COUNT > 14
+	PROV_FEATURE(14),
+#endif
+#if PWD_COUNT > 15
+	PROV_FEATURE(15),
+#endif
+	HID_RI_END_COLLECTION(0),
+};
 
 const USB_Descriptor_Device_t PROGMEM s_DeviceDescriptor =
 {
 	.Header                 = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
 
 	.USBSpecification       = VERSION_BCD(1,1,0),
-	.Class                  = CDC_CSCP_CDCClass,
-	.SubClass               = CDC_CSCP_NoSpecificSubclass,
-	.Protocol               = CDC_CSCP_NoSpecificProtocol,
+	.Class                  = USB_CSCP_IADDeviceClass,
+	.SubClass               = USB_CSCP_IADDeviceSubclass,
+	.Protocol               = USB_CSCP_IADDeviceProtocol,
 
 	.Endpoint0Size          = FIXED_CONTROL_ENDPOINT_SIZE,
 
 	.VendorID               = 0x03EB,
 	.ProductID              = 0x2044,
-	.ReleaseNumber          = VERSION_BCD(0,0,1),
+	.ReleaseNumber          = VERSION_BCD(0,0,2), // composite since 0.0.2, so hosts don't reuse what they cached
 
 	.ManufacturerStrIndex   = STRING_ID_Manufacturer,
 	.ProductStrIndex        = STRING_ID_Product,
@@ -29,7 +92,7 @@ const USB_Descriptor_Configuration_t PROGMEM s_ConfigurationDescriptor =
 			.Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
 
 			.TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
-			.TotalInterfaces        = 2,
+			.TotalInterfaces        = 3,
 
 			.ConfigurationNumber    = 1,
 			.ConfigurationStrIndex  = NO_DESCRIPTOR,
@@ -39,6 +102,20 @@ const USB_Descriptor_Configuration_t PROGMEM s_ConfigurationDescriptor =
 			.MaxPowerConsumption    = USB_CONFIG_POWER_MA(100)
 		},
 
+	.CDC_IAD =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_Association_t), .Type = DTYPE_InterfaceAssociation},
+
+			.FirstInterfaceIndex    = INTERFACE_ID_CDC_CCI,
+			.TotalInterfaces        = 2,
+
+			.Class                  = CDC_CSCP_CDCClass,
+			.SubClass               = CDC_CSCP_ACMSubclass,
+			.Protocol               = CDC_CSCP_ATCommandProtocol,
+
+			.IADStrIndex            = NO_DESCRIPTOR
+		},
+
 	.CDC_CCI_Interface =
 		{
 			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
@@ -124,6 +201,43 @@ const USB_Descriptor_Configuration_t PROGMEM s_ConfigurationDescriptor =
 			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
 			.EndpointSize           = CDC_TXRX_EPSIZE,
 			.PollingIntervalMS      = 0x05
+		},
+
+	.Prov_Interface =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+
+			.InterfaceNumber        = INTERFACE_ID_Prov,
+			.AlternateSetting       = 0x00,
+
+			.TotalEndpoints         = 1,
+
+			.Class                  = HID_CSCP_HIDClass,
+			.SubClass               = HID_CSCP_NonBootSubclass,
+			.Protocol               = HID_CSCP_NonBootProtocol,
+
+			.InterfaceStrIndex      = NO_DESCRIPTOR
+		},
+
+	.Prov_HID =
+		{
+			.Header                 = {.Size = sizeof(USB_HID_Descriptor_HID_t), .Type = HID_DTYPE_HID},
+
+			.HIDSpec                = VERSION_BCD(1,1,1),
+			.CountryCode            = 0x00,
+			.TotalReportDescriptors = 1,
+			.HIDReportType          = HID_DTYPE_Report,
+			.HIDReportLength        = sizeof(s_ProvReport)
+		},
+
+	.Prov_ReportINEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = PROV_IN_EPADDR,
+			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = PROV_EPSIZE,
+			.PollingIntervalMS      = 0xFF
 		}
 };
 
@@ -168,6 +282,14 @@ uint16_t s_CALLBACK_USB_GetDescriptor(const uint16_t wValue, const uint16_t wInd
 					break;
 			}
 
+			break;
+		case HID_DTYPE_HID:
+			Address = &s_ConfigurationDescriptor.Prov_HID;
+			Size    = sizeof(USB_HID_Descriptor_HID_t);
+			break;
+		case HID_DTYPE_Report:
+			Address = &s_ProvReport;
+			Size    = sizeof(s_ProvReport);
 			break;
 	}
 
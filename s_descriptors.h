@@ -5,6 +5,11 @@
 
 #include <avr/pgmspace.h>
 
+#include "Config/AppConfig.h" // endpoint sizes
+
+// Endpoint address of the provisioning HID IN endpoint, which HID requires but nothing is sent on.
+#define PROV_IN_EPADDR                 (ENDPOINT_DIR_IN  | 1)
+
 // Endpoint address of the CDC device-to-host notification IN endpoint.
 #define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 2)
 
@@ -14,12 +19,6 @@
 // Endpoint address of the CDC host-to-device data OUT endpoint.
 #define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
 
-// Size in bytes of the CDC device-to-host notification IN endpoint.
-#define CDC_NOTIFICATION_EPSIZE        8
-
-// Size in bytes of the CDC data IN and OUT endpoints.
-#define CDC_TXRX_EPSIZE                16
-
 /* Type define for the device configuration descriptor structure. This must be defined in the
 	application code, as the configuration descriptor contains several sub-descriptors which
 	vary between devices, and which describe the device's usage to the host. */
@@ -27,6 +26,9 @@ typedef struct
 {
 	USB_Descriptor_Configuration_Header_t    Config;
 
+	// CDC Interface Association, groups the two CDC interfaces into one function
+	USB_Descriptor_Interface_Association_t   CDC_IAD;
+
 	// CDC Control Interface
 	USB_Descriptor_Interface_t               CDC_CCI_Interface;
 	USB_CDC_Descriptor_FunctionalHeader_t    CDC_Functional_Header;
@@ -38,6 +40,11 @@ typedef struct
 	USB_Descriptor_Interface_t               CDC_DCI_Interface;
 	USB_Descriptor_Endpoint_t                CDC_DataOutEndpoint;
 	USB_Descriptor_Endpoint_t                CDC_DataInEndpoint;
+
+	// Provisioning HID Interface, vendor defined feature reports with slots
+	USB_Descriptor_Interface_t               Prov_Interface;
+	USB_HID_Descriptor_HID_t                 Prov_HID;
+	USB_Descriptor_Endpoint_t                Prov_ReportINEndpoint;
 } USB_Descriptor_Configuration_t;
 
 /* Enum for the device interface descriptor IDs within the device. Each interface descriptor
@@ -47,6 +54,7 @@ enum InterfaceDescriptors_t
 {
 	INTERFACE_ID_CDC_CCI = 0, // CDC CCI interface descriptor ID
 	INTERFACE_ID_CDC_DCI = 1, // CDC DCI interface descriptor ID
+	INTERFACE_ID_Prov    = 2, // provisioning HID interface descriptor ID
 };
 
 /* Enum for the device string descriptor IDs within the device. Each string descriptor should
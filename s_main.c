@@ -1,14 +1,18 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <avr/wdt.h>
 
 #include "s_descriptors.h"
 #include "circbuf8.h"
+#include "sched.h"
+#include "ser.h"
+#include "prov.h"
 #include "main.h"
 
 #include <LUFA/Drivers/USB/USB.h>
 
-uint8_t txbuf[64];
-uint8_t rxbuf[64];
+uint8_t txbuf[SER_RING_SIZE];
+uint8_t rxbuf[SER_RING_SIZE];
 static volatile struct cbuf8_t cdc_rxq;
 static volatile struct cbuf8_t cdc_txq;
 
@@ -19,21 +23,15 @@ static CDC_LineEncoding_t LineEncoding = {
 	.DataBits    = 8
 };
 
-uint8_t ptoi(const char c)
-{
-	if( c >= '0' && c <= '9' ) return c - '0';
-	if( c >= 'a' && c <= 'z' ) return c - 'a' + 10;
-
-	return 0;
-}
+static uint16_t LineState = 0; // CDC_CONTROL_LINE_OUT_* from the host
+static bool dtr = false; // DTR as CDC_Task last saw it
+static bool zlp = false; // last IN packet was full, a short one must follow
 
-char itop(const uint8_t a)
-{
-	if( a < 10 ) return ('0' + a);
-	if( a < 36 ) return ('a' + a - 10);
+#define TX_WAIT (100 * (F_CPU / 64 / 1000)) // timer0 counts a reply may wait for the host in all, 100 ms, within ser's deadline
+static uint16_t tx_waited; // timer0 counts the current command's reply has waited
+static bool tx_drop = false; // the rest of the reply is dropped, the host stopped reading or closed the port
 
-	return '?';
-}
+static bool restart = false; // r! was accepted, restart once its reply is out
 
 /* Event handler for the USB_ConfigurationChanged event. This is fired when the
 	host set the current configuration of the USB device after enumeration - the
@@ -47,16 +45,22 @@ void s_EVENT_USB_Device_ConfigurationChanged(void)
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(CDC_TX_EPADDR, EP_TYPE_BULK, CDC_TXRX_EPSIZE, 1);
 	ConfigSuccess &= Endpoint_ConfigureEndpoint(CDC_RX_EPADDR, EP_TYPE_BULK,  CDC_TXRX_EPSIZE, 1);
 
+	// Setup provisioning HID Endpoint
+	ConfigSuccess &= Endpoint_ConfigureEndpoint(PROV_IN_EPADDR, EP_TYPE_INTERRUPT, PROV_EPSIZE, 1);
+
 	// Reset line encoding baud rate so that the host knows to send new values
 	LineEncoding.BaudRateBPS = 0;
+	LineState = 0;
+	dtr = false;
+	zlp = false;
+
+	// Turn on Start-of-Frame events for polling the data endpoints once per frame
+	USB_Device_EnableSOFEvents();
 }
 
-/* Event handler for the USB_ControlRequest event. This is used to catch and
-	process control requests sent to the device from the USB host before passing
-	along unhandled control requests to the library for processing internally. */
-void s_EVENT_USB_Device_ControlRequest(void)
+// Process CDC specific control requests. CDC_Task reads what they set with interrupts off.
+static void CDC_ControlRequest(void)
 {
-	// Process CDC specific control requests
 	switch (USB_ControlRequest.bRequest)
 	{
 		case CDC_REQ_GetLineEncoding:
@@ -87,118 +91,158 @@ void s_EVENT_USB_Device_ControlRequest(void)
 				Endpoint_ClearSETUP();
 				Endpoint_ClearStatusStage();
 
-				/* NOTE: Here you can read in the line state mask from the host, to get
-					the current state of the output handshake lines. The mask is read in
-					from the wValue parameter in USB_ControlRequest, and can be masked
-					against the CONTROL_LINE_OUT_* masks to determine the RTS and DTR line
-					states using the following code: */
+				// DTR tells that a program on the host has the port open
+				LineState = USB_ControlRequest.wValue;
 			}
 
 			break;
 	}
 }
 
+/* Event handler for the USB_ControlRequest event. This is used to catch and
+	process control requests sent to the device from the USB host before passing
+	along unhandled control requests to the library for processing internally.
+	Runs from the USB interrupt (INTERRUPT_CONTROL_ENDPOINT). Class requests are
+	passed to the handler of the interface they address, by the interface number in wIndex. */
+void s_EVENT_USB_Device_ControlRequest(void)
+{
+	if( (USB_ControlRequest.wIndex & 0xff) == INTERFACE_ID_Prov ) {
+		Prov_ControlRequest();
+	} else {
+		CDC_ControlRequest();
+	}
+}
+
 // Function to manage CDC data transmission and reception to and from the host.
 void CDC_Task(void)
 {
 	if (USB_DeviceState != DEVICE_STATE_Configured) return;
 
-	uint8_t s[CDC_TXRX_EPSIZE];
-	uint8_t i, d;
-	for( i = 0; i < sizeof(s); ++i ) {
-	  if( !cbuf8_get(&cdc_txq, &d) ) break;
-		s[i] = d;
+	// set from the control request interrupt, more than a byte each
+	uint8_t g = SREG;
+	cli();
+	bool port_open = LineEncoding.BaudRateBPS || (LineState & CDC_CONTROL_LINE_OUT_DTR);
+	bool closed = dtr && !(LineState & CDC_CONTROL_LINE_OUT_DTR);
+	dtr = LineState & CDC_CONTROL_LINE_OUT_DTR;
+	SREG = g;
+
+	// The program that had the port open won't read the rest of a reply, nor should the next one
+	if( closed ) {
+		cbuf8_clear(&cdc_txq, txbuf, sizeof(txbuf));
+		Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+		Endpoint_AbortPendingIN();
+		zlp = false;
+		tx_drop = true;
 	}
 
-	if( i && LineEncoding.BaudRateBPS ) {
-		Endpoint_SelectEndpoint(CDC_TX_EPADDR);
-		Endpoint_Write_Stream_LE(s, i, NULL);
-		bool IsFull = (Endpoint_BytesInEndpoint() == CDC_TXRX_EPSIZE);
-		Endpoint_ClearIN();
-		if( IsFull ) {
-			Endpoint_WaitUntilReady();
+	// Data is kept queued until the host opens the port and has room for it
+	Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+	if( port_open && Endpoint_IsINReady() ) {
+		uint8_t i, d;
+		for( i = 0; i < CDC_TXRX_EPSIZE; ++i ) {
+			if( !cbuf8_get(&cdc_txq, &d) ) break;
+			Endpoint_Write_8(d);
+		}
+		if( i || zlp ) {
 			Endpoint_ClearIN();
+			zlp = (i == CDC_TXRX_EPSIZE);
 		}
 	}
 
+	// Leave the packet in the endpoint (host is NAKed) until it fits into the queue
 	Endpoint_SelectEndpoint(CDC_RX_EPADDR);
-	if( Endpoint_IsOUTReceived() ) {
-		d = Endpoint_BytesInEndpoint();
-		if( d > sizeof(s) ) d = sizeof(s);
-		Endpoint_Read_Stream_LE(s, d, NULL);
+	if( Endpoint_IsOUTReceived() && (cdc_rxq.size - cdc_rxq.len >= CDC_TXRX_EPSIZE) ) {
+		uint8_t d = Endpoint_BytesInEndpoint();
+		while( d-- ) cbuf8_put(&cdc_rxq, Endpoint_Read_8());
 		Endpoint_ClearOUT();
-		for( i = 0; i < d; ++i ) cbuf8_put(&cdc_rxq, s[i]);
+		sched_post(SCHED_EV_EP);
 	}
 }
 
-void Serial_SendByte(uint8_t a)
+/* Queue a byte for the host, waits while the queue is full. A reply that has waited TX_WAIT
+	in all, or whose port was closed, is dropped from there on, so a host that stopped reading
+	can't hold up the tasks. Returns false if the byte was dropped. */
+uint8_t Serial_SendByte(uint8_t a)
 {
-	cbuf8_put(&cdc_txq, a);
+	if( tx_drop ) return 0;
+
+	if( !cbuf8_put(&cdc_txq, a) ) {
+		uint16_t st = sched_now();
+		do {
+			if( (USB_DeviceState != DEVICE_STATE_Configured) || ((uint32_t)tx_waited + (uint16_t)(sched_now() - st) > TX_WAIT) ) {
+				tx_drop = true;
+				return 0;
+			}
+			CDC_Task();
+			if( tx_drop ) return 0; // the host closed the port
+		} while( !cbuf8_put(&cdc_txq, a) );
+		tx_waited += sched_now() - st;
+	}
+
+	sched_post(SCHED_EV_EP);
+	return 1;
 }
 
-void Serial_SendString(const char* s)
+void Ser_Task(void)
 {
-	while( *s ) {
-		Serial_SendByte(*s);
-		++s;
+	uint8_t d;
+	if( cbuf8_get(&cdc_rxq, &d) ) {
+		if( cbuf8_get(&cdc_rxq, NULL) ) { sched_post(SCHED_EV_EP); } // more to process
+		tx_waited = 0;
+		tx_drop = false;
+		Ser_ProcessByte(d);
 	}
 }
 
-void Ser_Task(void)
+// Accepts r! when the dip switches select a slot or the pipe, never setup or erase.
+uint8_t Sw_Restart(void)
 {
-	static uint8_t sbuf[40];
-	static uint8_t slen = 0;
+	uint8_t sw = readswi();
+	if( (sw == SW_SETUP_CMD) || (sw == SW_ERASE_CMD) ) return 0;
+	restart = true;
+	return 1;
+}
 
-	uint8_t d;
-	if( cbuf8_get(&cdc_rxq, &d) ) {
+// Restarts into the mode the dip switches select once r!'s reply is out, or the port
+// was closed, so a slot can be typed without unplugging, with the clock set by u= still running.
+void Sw_Task(void)
+{
+	if( !restart ) return;
 
-		if( slen >= sizeof(sbuf) ) { slen = 0; }
-
-		if( (d == '\r') || (d == '\n') ) {
-			if( slen == 0 ) return;
-			while( slen < sizeof(sbuf) ) { sbuf[slen++] = 0; }
-
-			uint8_t n = ptoi(sbuf[1]);
-			if( (sbuf[0] == 'p') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == '=') ) {
-				eeprom_update_block(sbuf+3, (void*)(PWD_SIZE * n), PWD_SIZE);
-				Serial_SendString("sto\r\n");
-			} else
-			if( (sbuf[0] == 'l') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == '?') ) {
-				uint8_t i;
-				for( i = 0; i < PWD_SIZE; ++i ) {
-					d = eeprom_read_byte((void*)(PWD_SIZE * n + i));
-					if( (d < ' ') || (d > '}') ) break;
-					Serial_SendByte(d);
-				}
-				Serial_SendString("\r\n");
-			} else
-			if( (sbuf[0] == 'c') && (sbuf[1] == '!') ) {
-				eeprom_erase();
-				Serial_SendString("clr\r\n");
-			} else {
-				Serial_SendString("err\r\n");
-			}
-		} else
-		if( d == 0x7f ) { // backspace
-			if( slen ) { --slen; }
-		} else { // store character
-			if( (d >= 32) && (d <= 126) ) { sbuf[slen++] = d; }
-		}
+	Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+	if( (USB_DeviceState == DEVICE_STATE_Configured) && (cdc_txq.len || zlp || !Endpoint_IsINReady()) ) return;
+
+	uint8_t sw = readswi();
+	if( (sw == SW_SETUP_CMD) || (sw == SW_ERASE_CMD) ) { // moved since r!
+		restart = false;
+		return;
 	}
+
+	USB_Disable();
+	cli();
+	wdt_enable(WDTO_15MS); // without WDIE, so no hang is recorded
+	while( 1 );
 }
 
-int s_main(void)
+void s_Init(void)
 {
 	cbuf8_clear(&cdc_rxq, rxbuf, sizeof(rxbuf));
 	cbuf8_clear(&cdc_txq, txbuf, sizeof(txbuf));
+}
+
+int s_main(void)
+{
+	s_Init();
+
+	sched_init();
+	// ser and prov write up to a slot to eeprom at a time, control requests are served from the USB interrupt meanwhile
+	sched_add(PSTR("cdc"), CDC_Task, SCHED_EV_SOF | SCHED_EV_TICK | SCHED_EV_EP, 2);
+	sched_add(PSTR("ser"), Ser_Task, SCHED_EV_EP, SCHED_MS(130)); // a slot write, 3.4 ms per eeprom byte
+	sched_add(PSTR("prov"), Prov_Task, SCHED_EV_EP, SCHED_MS(130));
+	sched_add(PSTR("sw"), Sw_Task, SCHED_EV_TICK, 2);
 
 	USB_Init();
 	sei();
 
-	while( 1 ) {
-		wdt_reset();
-		CDC_Task();
-		USB_USBTask();
-		Ser_Task();
-	}
+	sched_run();
 }
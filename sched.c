@@ -0,0 +1,331 @@
+/**
+password typist
+
+@file		sched.c
+@brief		Cooperative tick and event scheduler with watchdog supervision.
+@author		Matej Kogovsek
+@copyright	GPL v2
+*/
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+
+#include "sched.h"
+#include "rtc.h"
+#include "main.h"
+
+static struct sched_task_t tasks[SCHED_MAX_TASKS];
+static uint8_t ntasks = 0;
+
+static volatile uint8_t pending = 0;
+static volatile uint8_t ticks = 0;
+static uint8_t swlast = 0;
+
+static volatile uint8_t current = 0xff; // index of running task, 0xff when in scheduler
+static volatile uint16_t fed; // time of last feed, deadlines count from here
+static void (*wdt_hook)(void) = NULL; // watchdog borrowed as a 16 ms interrupt when set
+static uint16_t sof_last; // time of last SOF interrupt
+static volatile uint8_t irq_late = 0; // max SOF interrupt latency, timer0 counts
+static volatile uint8_t sleep_mode = SLEEP_MODE_IDLE; // when no task is ready
+
+// survives watchdog reset, saved to eeprom on next boot
+static struct sched_trap_t trap __attribute__((section(".noinit")));
+_Static_assert(TRAP_EEADDR + sizeof(struct sched_trap_t) <= E2END + 1, "trap record doesn't fit the eeprom after the slots");
+
+// posts a tick and polls dip switches for changes, from timer0 or, while suspended, the watchdog
+static void sched_tick(void)
+{
+	uint8_t sw = PIN(SW_PORT) & SW_MASK;
+	if( sw != swlast ) {
+		swlast = sw;
+		pending |= SCHED_EV_PIN;
+	}
+
+	pending |= SCHED_EV_TICK;
+}
+
+// timer0 overflow
+ISR(TIMER0_OVF_vect)
+{
+	++ticks;
+	sched_tick();
+}
+
+/**
+@brief Returns time in timer0 counts of 64 CPU clocks (8 us at 8 MHz, 4 us at 16 MHz), for measuring run times. Interrupt safe.
+@return Time, wraps every 256 ticks.
+*/
+uint16_t sched_now(void)
+{
+	uint8_t g = SREG;
+	cli();
+
+	uint8_t c = TCNT0;
+	uint8_t t = ticks;
+	if( (TIFR0 & _BV(TOV0)) && (c < 128) ) { ++t; } // overflow not yet serviced
+
+	SREG = g;
+	return ((uint16_t)t << 8) | c;
+}
+
+static void sched_trap_set(const uint8_t cause, const uint16_t dur)
+{
+	const char* n = (current < ntasks) ? tasks[current].name : PSTR("schd");
+	uint8_t i;
+	for( i = 0; i < SCHED_NAME_LEN; ++i ) {
+		trap.name[i] = pgm_read_byte(n);
+		if( trap.name[i] ) ++n;
+	}
+	trap.cause = cause;
+	trap.dur = dur;
+	trap.magic = SCHED_TRAP_MAGIC;
+}
+
+// watchdog interrupt, fires one timeout before the watchdog resets the mcu
+ISR(WDT_vect)
+{
+	if( wdt_hook ) {
+		wdt_hook();
+		return;
+	}
+
+	sched_trap_set(SCHED_TRAP_HANG, 0xffff);
+	while( 1 ); // wait for reset
+}
+
+// supervision on, as set up by sched_run
+static void sched_wdt_on(void)
+{
+#ifdef SCHED_WDT
+	wdt_enable(SCHED_WDT);
+	WDTCSR |= _BV(WDIE); // interrupt first, reset on next timeout
+#endif
+}
+
+/**
+@brief Starts timer0 (clk/64) used for ticks and run time measurement.
+*/
+void sched_init(void)
+{
+	ntasks = 0;
+	pending = 0;
+	swlast = PIN(SW_PORT) & SW_MASK;
+
+	TCCR0A = 0;
+	TCCR0B = _BV(CS01) | _BV(CS00);
+	TIMSK0 = _BV(TOIE0);
+}
+
+/**
+@brief Registers a task.
+@param[in]	name		Task name in flash, up to SCHED_NAME_LEN chars
+@param[in]	fn			Task function
+@param[in]	events		Mask of SCHED_EV_* events on which the task is run
+@param[in]	deadline	Max run time in ticks, longer runs are recorded as overruns
+@return Task index or 0xff if the task table is full.
+*/
+uint8_t sched_add(const char* name, void (*fn)(void), const uint8_t events, const uint8_t deadline)
+{
+	if( ntasks >= SCHED_MAX_TASKS ) return 0xff;
+
+	struct sched_task_t* t = &tasks[ntasks];
+	t->fn = fn;
+	t->name = name;
+	t->events = events;
+	t->deadline = deadline;
+	uint8_t i;
+	for( i = 0; i < SCHED_HIST_BINS; ++i ) t->hist[i] = 0;
+
+	return ntasks++;
+}
+
+/**
+@brief Makes tasks waiting for given events ready. Interrupt safe.
+@param[in]	ev		Mask of SCHED_EV_* events
+*/
+void sched_post(const uint8_t ev)
+{
+	uint8_t g = SREG;
+	cli();
+	pending |= ev;
+	SREG = g;
+}
+
+/**
+@brief Posts SCHED_EV_SOF and records how late the SOF interrupt ran. Call from the SOF event.
+
+Frames are exactly 1 ms apart, so the time past SCHED_SOF_PERIOD since the
+previous SOF is how long interrupts were held off, by cli sections or other
+interrupts. The control endpoint interrupt waits behind the same.
+*/
+void sched_sof(void)
+{
+	uint16_t now = sched_now();
+	uint16_t d = now - sof_last - SCHED_SOF_PERIOD; // wraps when early, after a late one
+	sof_last = now;
+	if( (d < SCHED_SOF_PERIOD) && (d > irq_late) ) { irq_late = d; } // longer gaps are missed frames
+
+	sched_post(SCHED_EV_SOF);
+}
+
+/**
+@brief Returns the max SOF interrupt latency seen, see sched_sof.
+@return Latency in timer0 counts.
+*/
+uint8_t sched_irq_latency(void)
+{
+	return irq_late;
+}
+
+/**
+@brief Resets the watchdog and restarts the running task's deadline. For long legitimate operations.
+*/
+void sched_feed(void)
+{
+	wdt_reset();
+	fed = sched_now();
+}
+
+/**
+@brief Lends the watchdog out as a plain 16 ms interrupt, without supervision, or takes it back.
+@param[in]	fn		Called from the watchdog interrupt, NULL restores supervision
+*/
+void sched_wdt_hook(void (*fn)(void))
+{
+	uint8_t g = SREG;
+	cli();
+	wdt_reset();
+	wdt_hook = fn;
+	if( fn ) {
+		WDTCSR = _BV(WDCE) | _BV(WDE);
+		WDTCSR = _BV(WDIE); // interrupt only, WDTO_15MS
+	} else {
+		wdt_disable();
+		sched_wdt_on();
+	}
+	SREG = g;
+}
+
+/**
+@brief Enters or leaves USB suspend. Interrupt safe, for the USB suspend and wakeup events.
+
+While suspended timer0 is stopped, with run time measurement, and the watchdog
+interrupt ticks instead, every 16 ms, so the dip switches are still polled.
+The scheduler sleeps in power down, which stops the crystal and timer1 with
+it, so once the clock is set it sleeps in idle to keep time for TOTP.
+@param[in]	on		True on suspend, false on wakeup
+*/
+void sched_suspend(const uint8_t on)
+{
+	uint8_t g = SREG;
+	cli();
+	if( on ) {
+		TCCR0B = 0;
+		TIMSK0 = 0;
+		sched_wdt_hook(sched_tick);
+		uint32_t t;
+		sleep_mode = rtc_get(&t) ? SLEEP_MODE_IDLE : SLEEP_MODE_PWR_DOWN;
+	} else {
+		sleep_mode = SLEEP_MODE_IDLE;
+		sched_wdt_hook(NULL);
+		TIFR0 = _BV(TOV0);
+		TIMSK0 = _BV(TOIE0);
+		TCCR0B = _BV(CS01) | _BV(CS00);
+	}
+	SREG = g;
+}
+
+/**
+@brief Returns a registered task, used to read out the histograms.
+@param[in]	i		Task index
+@return Pointer to task or NULL if i is out of range.
+*/
+const struct sched_task_t* sched_get(const uint8_t i)
+{
+	if( i >= ntasks ) return NULL;
+	return &tasks[i];
+}
+
+/**
+@brief Moves a trap recorded before reset to eeprom. Call once at boot.
+*/
+void sched_trap_save(void)
+{
+	if( trap.magic == SCHED_TRAP_MAGIC ) {
+		eeprom_update_block(&trap, (void*)TRAP_EEADDR, sizeof(trap));
+	}
+	trap.magic = 0;
+}
+
+/**
+@brief Gets last recorded trap, from this run if any, otherwise from eeprom.
+@param[out]	tr		Pointer to sched_trap_t where the trap is copied
+@return True if a trap was recorded, false otherwise.
+*/
+uint8_t sched_trap_get(struct sched_trap_t* tr)
+{
+	uint8_t g = SREG;
+	cli();
+	*tr = trap;
+	SREG = g;
+
+	if( tr->magic != SCHED_TRAP_MAGIC ) {
+		eeprom_read_block(tr, (void*)TRAP_EEADDR, sizeof(*tr));
+	}
+
+	return tr->magic == SCHED_TRAP_MAGIC;
+}
+
+/**
+@brief Runs ready tasks forever, sleeps when none are ready, in idle mode unless suspended.
+*/
+void sched_run(void)
+{
+	sched_wdt_on();
+
+	while( 1 ) {
+		wdt_reset();
+
+		cli();
+		uint8_t ev = pending;
+		pending = 0;
+		if( ev == 0 ) {
+			// sei must directly precede sleep so a wakeup interrupt can't be missed
+			set_sleep_mode(sleep_mode);
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+			continue;
+		}
+		sei();
+
+		uint8_t i;
+		for( i = 0; i < ntasks; ++i ) {
+			struct sched_task_t* t = &tasks[i];
+			if( !(t->events & ev) ) continue;
+
+			uint16_t st = sched_now();
+			fed = st;
+			current = i;
+			t->fn();
+			current = 0xff;
+			uint16_t now = sched_now();
+
+			if( (now - fed) > ((uint16_t)t->deadline << 8) ) {
+				sched_trap_set(SCHED_TRAP_OVERRUN, now - st);
+			}
+
+			uint16_t d = now - st;
+			uint8_t b = 0;
+			while( (d >>= 1) && (b < SCHED_HIST_BINS - 1) ) { ++b; }
+			if( t->hist[b] != 0xffff ) { ++t->hist[b]; }
+
+			wdt_reset();
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/wdt.h>
+
+// events a task can wait for
+#define SCHED_EV_TICK	_BV(0)	/**< timer tick, every 256 timer0 counts (64 * 256 CPU clocks, 2.048 ms at 8 MHz), 16 ms while suspended */
+#define SCHED_EV_SOF	_BV(1)	/**< USB start of frame */
+#define SCHED_EV_EP		_BV(2)	/**< data queued to or from an endpoint */
+#define SCHED_EV_EEPROM	_BV(3)	/**< eeprom ready for next write */
+#define SCHED_EV_PIN	_BV(4)	/**< dip switch state changed */
+
+#define SCHED_MAX_TASKS 4
+#define SCHED_HIST_BINS 8
+
+// watchdog timeout while tasks are running, comment out to run unsupervised
+#define SCHED_WDT WDTO_250MS
+
+// ticks in ms milliseconds, rounded up, for waits and deadlines set by the clock rather than by the CPU
+#define SCHED_MS(ms) (((uint32_t)(ms) * (F_CPU / 64 / 256) + 999) / 1000)
+
+// timer0 counts per USB frame, SOF interrupts later than this after the previous one are counted as latency
+#define SCHED_SOF_PERIOD (F_CPU / 64 / 1000)
+
+#define SCHED_NAME_LEN 4
+#define SCHED_TRAP_MAGIC 0xa5
+
+// trap causes
+#define SCHED_TRAP_HANG		'h'	/**< watchdog fired while the task was running */
+#define SCHED_TRAP_OVERRUN	'o'	/**< task returned after its deadline */
+
+struct sched_task_t
+{
+	void (*fn)(void); /**< task function */
+	const char* name; /**< task name in flash */
+	uint8_t events; /**< events that make the task ready */
+	uint8_t deadline; /**< max run time in ticks */
+	uint16_t hist[SCHED_HIST_BINS]; /**< run time histogram, bin n counts runs of 2^n..2^(n+1)-1 timer0 counts */
+};
+
+struct sched_trap_t
+{
+	uint8_t magic; /**< SCHED_TRAP_MAGIC if valid */
+	uint8_t cause; /**< SCHED_TRAP_* */
+	char name[SCHED_NAME_LEN]; /**< name of offending task */
+	uint16_t dur; /**< run time in timer0 counts, 0xffff for hangs */
+};
+
+void sched_init(void);
+uint8_t sched_add(const char* name, void (*fn)(void), const uint8_t events, const uint8_t deadline);
+void sched_post(const uint8_t ev);
+void sched_sof(void);
+uint8_t sched_irq_latency(void);
+void sched_feed(void);
+uint16_t sched_now(void);
+void sched_wdt_hook(void (*fn)(void));
+void sched_suspend(const uint8_t on);
+const struct sched_task_t* sched_get(const uint8_t i);
+void sched_trap_save(void);
+uint8_t sched_trap_get(struct sched_trap_t* tr);
+void sched_run(void) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,370 @@
+/**
+password typist
+
+@file		ser.c
+@brief		Setup mode command line protocol and slot storage.
+@author		Matej Kogovsek
+@copyright	GPL v2
+*/
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+
+#include "sched.h"
+#include "rtc.h"
+#include "totp.h"
+#include "slot.h"
+#include "rng.h"
+#include "layout.h"
+#include "ser.h"
+#include "main.h"
+
+uint8_t ptoi(const char c)
+{
+	if( c >= '0' && c <= '9' ) return c - '0';
+	if( c >= 'a' && c <= 'z' ) return c - 'a' + 10;
+
+	return 0;
+}
+
+char itop(const uint8_t a)
+{
+	if( a < 10 ) return ('0' + a);
+	if( a < 36 ) return ('a' + a - 10);
+
+	return '?';
+}
+
+void Serial_SendString_P(const char* s)
+{
+	char c;
+	while( (c = pgm_read_byte(s)) ) {
+		Serial_SendByte(c);
+		++s;
+	}
+}
+
+void Serial_SendHex16(uint16_t a)
+{
+	uint8_t i;
+	for( i = 0; i < 4; ++i ) {
+		Serial_SendByte(itop(a >> 12));
+		a <<= 4;
+	}
+}
+
+// print run time histograms of scheduler tasks, then the max interrupt latency
+void Ser_SendStats(void)
+{
+	const struct sched_task_t* t;
+	uint8_t i, j;
+	for( i = 0; (t = sched_get(i)); ++i ) {
+		Serial_SendByte(itop(i));
+		Serial_SendByte(':');
+		for( j = 0; j < SCHED_HIST_BINS; ++j ) {
+			Serial_SendByte(' ');
+			Serial_SendHex16(t->hist[j]);
+		}
+		Serial_SendString_P(PSTR("\r\n"));
+	}
+	Serial_SendString_P(PSTR("i: "));
+	Serial_SendHex16(sched_irq_latency());
+	Serial_SendString_P(PSTR("\r\n"));
+}
+
+// print printable part of slot n
+void Ser_SendSlot(const uint8_t n)
+{
+	uint8_t b[PWD_SIZE];
+	slot_read(n, b);
+
+	uint8_t i;
+	for( i = 0; i < PWD_SIZE; ++i ) {
+		if( (b[i] < ' ') || (b[i] > '~') ) break;
+		Serial_SendByte(b[i]);
+	}
+}
+
+// print slot n as the command that stores it, p#= for plain text, m#= with hex bytecode otherwise
+void Ser_SendSlotCmd(const uint8_t n)
+{
+	uint8_t b[PWD_SIZE];
+	slot_read(n, b);
+
+	uint8_t i, len = 0, text = 1;
+	for( i = 0; i < PWD_SIZE; ++i ) {
+		if( b[i] == 0 ) continue;
+		if( (len != i) || (b[i] < ' ') || (b[i] > '~') ) { text = 0; } // gap or op
+		len = i + 1;
+	}
+
+	Serial_SendByte(text ? 'p' : 'm');
+	Serial_SendByte(itop(n));
+	Serial_SendByte('=');
+	for( i = 0; i < len; ++i ) {
+		if( text ) {
+			Serial_SendByte(b[i]);
+		} else {
+			Serial_SendByte(itop(b[i] >> 4));
+			Serial_SendByte(itop(b[i] & 0x0f));
+		}
+	}
+	Serial_SendString_P(PSTR("\r\n"));
+}
+
+static uint8_t ishex(const uint8_t c)
+{
+	return ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'f'));
+}
+
+// converts zero terminated hex string at s to PWD_SIZE zero padded bytes in place, returns 0 on bad hex
+static uint8_t hex2slot(uint8_t* s)
+{
+	uint8_t i;
+	for( i = 0; (i < PWD_SIZE) && s[2*i]; ++i ) {
+		if( !ishex(s[2*i]) || !ishex(s[2*i+1]) ) return 0;
+		s[i] = (ptoi(s[2*i]) << 4) | ptoi(s[2*i+1]);
+	}
+	while( i < PWD_SIZE ) { s[i++] = 0; }
+
+	return 1;
+}
+
+// hex string at s to *v, returns 0 if s is empty, too long or not hex
+static uint8_t hex2u32(const uint8_t* s, uint32_t* v)
+{
+	uint8_t i;
+	*v = 0;
+	for( i = 0; s[i]; ++i ) {
+		if( (i == 8) || !ishex(s[i]) ) return 0;
+		*v = (*v << 4) | ptoi(s[i]);
+	}
+
+	return i;
+}
+
+// print current TOTP code of slot n and how long it took in timer0 counts
+void Ser_SendTotp(const uint8_t n)
+{
+	uint8_t b[PWD_SIZE];
+	slot_read(n, b);
+
+	char code[TOTP_DIGITS];
+	uint16_t st = sched_now();
+	if( !totp_slot(code, b) ) {
+		Serial_SendString_P(PSTR("err\r\n"));
+		return;
+	}
+	uint16_t d = sched_now() - st;
+
+	uint8_t i;
+	for( i = 0; i < TOTP_DIGITS; ++i ) Serial_SendByte(code[i]);
+	Serial_SendByte(' ');
+	Serial_SendHex16(d);
+	Serial_SendString_P(PSTR("\r\n"));
+}
+
+// characters g# draws from, typable without dead keys in every layout; charsets are prefixes
+static const char gen_chars[] PROGMEM = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ!\"#$%&/()='?+*,;<.:>-_\\|[]{}@";
+
+// number of gen_chars in charset c, 0 if unknown
+static uint8_t gen_charset(const uint8_t c)
+{
+	if( c == 'd' ) return 10; // digits
+	if( c == 'l' ) return 36; // and lowercase
+	if( c == 'a' ) return 62; // and uppercase
+	if( c == 'p' ) return sizeof(gen_chars) - 1; // and symbols
+	return 0;
+}
+
+// generates a password from s = "len,charset" into slot n, returns 0 on bad arguments
+uint8_t Ser_Generate(const uint8_t n, const uint8_t* s)
+{
+	uint8_t len = 0, digits = 0;
+	while( (*s >= '0') && (*s <= '9') ) {
+		if( (++digits > 2) || (len * 10 + (*s - '0') > PWD_SIZE) ) return 0;
+		len = len * 10 + (*s++ - '0');
+	}
+
+	uint8_t m = gen_charset(s[1]);
+	if( (len == 0) || (len > PWD_SIZE) || (s[0] != ',') || (m == 0) || s[2] ) return 0;
+
+	rng_seed(NULL);
+
+	uint8_t b[PWD_SIZE] = {0};
+	uint8_t i = 0, lim = 256 - 256 % m; // reject bytes that would favour the first chars
+	while( i < len ) {
+		uint8_t r = rng_byte();
+		if( (lim == 0) || (r < lim) ) { b[i++] = pgm_read_byte(&gen_chars[r % m]); }
+	}
+	slot_write(n, b);
+
+	return 1;
+}
+
+// print entropy source statistics, a histogram of the low nibble of the samples and how long they took
+void Ser_SendEntropy(void)
+{
+	uint16_t hist[16] = {0};
+	uint16_t ms = rng_seed(hist);
+
+	uint8_t i;
+	for( i = 0; i < 16; ++i ) {
+		if( i ) Serial_SendByte(' ');
+		Serial_SendHex16(hist[i]);
+	}
+	Serial_SendString_P(PSTR("\r\n"));
+	Serial_SendHex16(ms);
+	Serial_SendString_P(PSTR("\r\n"));
+}
+
+// CRC-32 (IEEE 802.3) of all PWD_SIZE plaintext bytes of slot n
+uint32_t Ser_SlotCrc32(const uint8_t n)
+{
+	uint8_t b[PWD_SIZE];
+	slot_read(n, b);
+
+	uint32_t crc = 0xffffffff;
+	uint8_t i, j;
+	for( i = 0; i < PWD_SIZE; ++i ) {
+		crc ^= b[i];
+		for( j = 0; j < 8; ++j ) {
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+		}
+	}
+
+	return ~crc;
+}
+
+// print last recorded task overrun or hang
+void Ser_SendTrap(void)
+{
+	struct sched_trap_t tr;
+	if( !sched_trap_get(&tr) ) {
+		Serial_SendString_P(PSTR("none\r\n"));
+		return;
+	}
+
+	uint8_t i;
+	Serial_SendByte(tr.cause);
+	Serial_SendByte(' ');
+	for( i = 0; (i < SCHED_NAME_LEN) && tr.name[i]; ++i ) Serial_SendByte(tr.name[i]);
+	Serial_SendByte(' ');
+	Serial_SendHex16(tr.dur);
+	Serial_SendString_P(PSTR("\r\n"));
+}
+
+/**
+@brief Feeds a received byte to the command line parser, executes complete commands.
+@param[in]	d		Received byte
+*/
+void Ser_ProcessByte(uint8_t d)
+{
+	static uint8_t sbuf[SER_LINE_SIZE];
+	static uint8_t slen = 0;
+
+	if( slen >= sizeof(sbuf) ) { slen = 0; }
+
+	if( (d == '\r') || (d == '\n') ) {
+		if( slen == 0 ) return;
+		while( slen < sizeof(sbuf) ) { sbuf[slen++] = 0; }
+
+		uint8_t n = ptoi(sbuf[1]);
+		uint32_t t;
+		if( (sbuf[0] == 'p') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == '=') ) {
+			slot_write(n, sbuf+3);
+			Serial_SendString_P(PSTR("sto\r\n"));
+		} else
+		if( (sbuf[0] == 'm') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == '=') && hex2slot(sbuf+3) ) {
+			slot_write(n, sbuf+3);
+			Serial_SendString_P(PSTR("sto\r\n"));
+		} else
+		if( (sbuf[0] == 'l') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == '?') ) {
+			if( !slot_check(n) ) { Serial_SendString_P(PSTR("# bad\r\n")); }
+			Ser_SendSlot(n);
+			Serial_SendString_P(PSTR("\r\n"));
+		} else
+		if( (sbuf[0] == 'L') && (sbuf[1] == '?') ) {
+			for( n = 1; n < PWD_COUNT; ++n ) {
+				if( !slot_check(n) ) { Serial_SendString_P(PSTR("# bad\r\n")); } // a comment line in a vault file
+				Ser_SendSlotCmd(n);
+			}
+			Serial_SendString_P(PSTR("end\r\n"));
+		} else
+		if( (sbuf[0] == 'H') && (sbuf[1] == '?') ) {
+			for( n = 1; n < PWD_COUNT; ++n ) {
+				Serial_SendByte(itop(n));
+				Serial_SendByte(':');
+				uint32_t crc = Ser_SlotCrc32(n);
+				Serial_SendHex16(crc >> 16);
+				Serial_SendHex16(crc);
+				if( !slot_check(n) ) { Serial_SendString_P(PSTR(" bad")); }
+				Serial_SendString_P(PSTR("\r\n"));
+			}
+			Serial_SendString_P(PSTR("end\r\n"));
+		} else
+		if( (sbuf[0] == 'r') && (sbuf[1] == '!') && Sw_Restart() ) {
+			Serial_SendString_P(PSTR("rst\r\n"));
+		} else
+		if( (sbuf[0] == 'c') && (sbuf[1] == '!') ) {
+			slot_lock(1);
+			eeprom_erase();
+			slot_lock(0);
+			Serial_SendString_P(PSTR("clr\r\n"));
+		} else
+		if( (sbuf[0] == 't') && (sbuf[1] == '?') ) {
+			Ser_SendStats();
+		} else
+		if( (sbuf[0] == 'w') && (sbuf[1] == '?') ) {
+			Ser_SendTrap();
+		} else
+		if( (sbuf[0] == 'u') && (sbuf[1] == '=') && hex2u32(sbuf+2, &t) ) {
+			rtc_set(t);
+			Serial_SendString_P(PSTR("sto\r\n"));
+		} else
+		if( (sbuf[0] == 'u') && (sbuf[1] == '?') ) {
+			if( rtc_get(&t) ) {
+				Serial_SendHex16(t >> 16);
+				Serial_SendHex16(t);
+				Serial_SendString_P(PSTR("\r\n"));
+			} else {
+				Serial_SendString_P(PSTR("none\r\n"));
+			}
+		} else
+		if( (sbuf[0] == 'o') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == '?') ) {
+			Ser_SendTotp(n);
+		} else
+		if( (sbuf[0] == 'g') && (n > 0) && (n < PWD_COUNT) && (sbuf[2] == ',') && Ser_Generate(n, sbuf+3) ) {
+			Serial_SendString_P(PSTR("sto\r\n"));
+		} else
+		if( (sbuf[0] == 'e') && (sbuf[1] == '?') ) {
+			Ser_SendEntropy();
+		} else
+		if( (sbuf[0] == 'k') && (sbuf[1] == '=') && (layout_find((char*)sbuf+2) < LAYOUT_COUNT) && !sbuf[4] ) {
+			eeprom_update_byte((void*)META_LAYOUT, layout_find((char*)sbuf+2));
+			Serial_SendString_P(PSTR("sto\r\n"));
+		} else
+		if( (sbuf[0] == 'k') && (sbuf[1] == '?') ) {
+			const char* name = layout_name(eeprom_read_byte((void*)META_LAYOUT));
+			Serial_SendByte(pgm_read_byte(&name[0]));
+			Serial_SendByte(pgm_read_byte(&name[1]));
+			Serial_SendString_P(PSTR("\r\n"));
+		} else
+		if( (sbuf[0] == 'C') && (sbuf[1] == '=') && ((sbuf[2] == 's') || (sbuf[2] == 't')) && !sbuf[3] ) {
+			eeprom_update_byte((void*)META_CAPS, (sbuf[2] == 't') ? CAPS_TAP : CAPS_SHIFT);
+			Serial_SendString_P(PSTR("sto\r\n"));
+		} else
+		if( (sbuf[0] == 'C') && (sbuf[1] == '?') ) {
+			Serial_SendByte((eeprom_read_byte((void*)META_CAPS) == CAPS_TAP) ? 't' : 's');
+			Serial_SendString_P(PSTR("\r\n"));
+		} else {
+			Serial_SendString_P(PSTR("err\r\n"));
+		}
+	} else
+	if( d == 0x7f ) { // backspace
+		if( slen ) { --slen; }
+	} else { // store character
+		if( (d >= 32) && (d <= 126) ) { sbuf[slen++] = d; }
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef SER_H
+#define SER_H
+
+#include <inttypes.h>
+
+uint8_t ptoi(const char c);
+char itop(const uint8_t a);
+
+// provided by the transport, s_main.c on the device
+uint8_t Serial_SendByte(uint8_t a);
+uint8_t Sw_Restart(void);
+
+void Serial_SendString_P(const char* s);
+void Serial_SendHex16(uint16_t a);
+void Ser_SendSlot(const uint8_t n);
+void Ser_SendSlotCmd(const uint8_t n);
+uint32_t Ser_SlotCrc32(const uint8_t n);
+void Ser_ProcessByte(uint8_t d);
+
+#endif
@@ -0,0 +1,158 @@
+/**
+password typist
+
+@file		sha1.c
+@brief		SHA-1 and HMAC-SHA1 without heap or large stack buffers.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+The 80 word message schedule is computed in place over the 16 words of the
+block buffer, so a hash needs no memory beyond its state. Words are assembled
+byte by byte, which avr-gcc turns into plain moves instead of 32 bit shifts.
+*/
+
+#include <inttypes.h>
+
+#include "sha1.h"
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static uint32_t get32be(const uint8_t* p)
+{
+	union { uint32_t w; uint8_t b[4]; } u;
+	u.b[3] = p[0];
+	u.b[2] = p[1];
+	u.b[1] = p[2];
+	u.b[0] = p[3];
+	return u.w;
+}
+
+static void put32be(uint8_t* p, const uint32_t w)
+{
+	union { uint32_t w; uint8_t b[4]; } u;
+	u.w = w;
+	p[0] = u.b[3];
+	p[1] = u.b[2];
+	p[2] = u.b[1];
+	p[3] = u.b[0];
+}
+
+// compresses the full block in s->buf
+static void sha1_block(struct sha1_t* s)
+{
+	uint32_t* w = s->buf.w;
+	uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3], e = s->h[4];
+	uint8_t i;
+
+	for( i = 0; i < 16; ++i ) { w[i] = get32be(s->buf.b + 4 * i); }
+
+	for( i = 0; i < 80; ++i ) {
+		uint32_t f, k;
+		if( i >= 16 ) {
+			uint32_t t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+			w[i & 15] = ROL(t, 1);
+		}
+
+		if( i < 20 ) { f = d ^ (b & (c ^ d)); k = 0x5a827999; } else
+		if( i < 40 ) { f = b ^ c ^ d; k = 0x6ed9eba1; } else
+		if( i < 60 ) { f = (b & c) | (d & (b | c)); k = 0x8f1bbcdc; } else
+		{ f = b ^ c ^ d; k = 0xca62c1d6; }
+
+		uint32_t t = ROL(a, 5) + f + e + k + w[i & 15];
+		e = d;
+		d = c;
+		c = ROL(b, 30);
+		b = a;
+		a = t;
+	}
+
+	s->h[0] += a;
+	s->h[1] += b;
+	s->h[2] += c;
+	s->h[3] += d;
+	s->h[4] += e;
+
+	s->len = 0;
+	++s->blocks;
+}
+
+/**
+@brief Starts a new hash.
+@param[out]	s		Pointer to sha1_t struct where hash state will be kept
+*/
+void sha1_init(struct sha1_t* s)
+{
+	s->h[0] = 0x67452301;
+	s->h[1] = 0xefcdab89;
+	s->h[2] = 0x98badcfe;
+	s->h[3] = 0x10325476;
+	s->h[4] = 0xc3d2e1f0;
+	s->len = 0;
+	s->blocks = 0;
+}
+
+/**
+@brief Hashes more data.
+@param[in]	s		Pointer to hash state
+@param[in]	d		Data
+@param[in]	n		Data length
+*/
+void sha1_update(struct sha1_t* s, const uint8_t* d, uint8_t n)
+{
+	while( n-- ) {
+		s->buf.b[s->len++] = *d++;
+		if( s->len == SHA1_BLOCK ) { sha1_block(s); }
+	}
+}
+
+/**
+@brief Pads the message and outputs the hash. The state must be reinitialized before reuse.
+@param[in]	s		Pointer to hash state
+@param[out]	hash	SHA1_HASH bytes
+*/
+void sha1_final(struct sha1_t* s, uint8_t* hash)
+{
+	uint32_t bits = ((uint32_t)s->blocks * SHA1_BLOCK + s->len) << 3;
+
+	s->buf.b[s->len++] = 0x80;
+	if( s->len > SHA1_BLOCK - 8 ) {
+		while( s->len < SHA1_BLOCK ) { s->buf.b[s->len++] = 0; }
+		sha1_block(s);
+	}
+	while( s->len < SHA1_BLOCK - 4 ) { s->buf.b[s->len++] = 0; }
+	put32be(s->buf.b + SHA1_BLOCK - 4, bits);
+	sha1_block(s);
+
+	uint8_t i;
+	for( i = 0; i < 5; ++i ) { put32be(hash + 4 * i, s->h[i]); }
+}
+
+// hashes key xor pad, padded with pad to a full block
+static void hmac_pad(struct sha1_t* s, const uint8_t* key, const uint8_t klen, const uint8_t pad)
+{
+	uint8_t i;
+	sha1_init(s);
+	for( i = 0; i < SHA1_BLOCK; ++i ) { s->buf.b[i] = ((i < klen) ? key[i] : 0) ^ pad; }
+	sha1_block(s);
+}
+
+/**
+@brief Computes HMAC-SHA1 (RFC 2104).
+@param[out]	mac		SHA1_HASH bytes
+@param[in]	key		Key, at most SHA1_BLOCK bytes
+@param[in]	klen	Key length
+@param[in]	msg		Message
+@param[in]	mlen	Message length
+*/
+void hmac_sha1(uint8_t* mac, const uint8_t* key, const uint8_t klen, const uint8_t* msg, const uint8_t mlen)
+{
+	struct sha1_t s;
+
+	hmac_pad(&s, key, klen, 0x36);
+	sha1_update(&s, msg, mlen);
+	sha1_final(&s, mac);
+
+	hmac_pad(&s, key, klen, 0x5c);
+	sha1_update(&s, mac, SHA1_HASH);
+	sha1_final(&s, mac);
+}
@@ -0,0 +1,25 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <inttypes.h>
+
+#define SHA1_BLOCK 64
+#define SHA1_HASH 20
+
+struct sha1_t
+{
+	uint32_t h[5]; /**< hash state */
+	union {
+		uint8_t b[SHA1_BLOCK];
+		uint32_t w[SHA1_BLOCK / 4];
+	} buf; /**< partial block, also the message schedule */
+	uint8_t len; /**< bytes in buf */
+	uint16_t blocks; /**< complete blocks hashed */
+};
+
+void sha1_init(struct sha1_t* s);
+void sha1_update(struct sha1_t* s, const uint8_t* d, uint8_t n);
+void sha1_final(struct sha1_t* s, uint8_t* hash);
+void hmac_sha1(uint8_t* mac, const uint8_t* key, const uint8_t klen, const uint8_t* msg, const uint8_t mlen);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef SLOT_H
+#define SLOT_H
+
+#include <inttypes.h>
+
+void slot_read(const uint8_t n, uint8_t* b);
+void slot_write(const uint8_t n, const uint8_t* b);
+uint8_t slot_check(const uint8_t n);
+void slot_lock(const uint8_t on);
+uint8_t slot_locked(void);
+
+#endif
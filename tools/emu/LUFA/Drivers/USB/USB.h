@@ -0,0 +1,358 @@
+/* Host stand-in for the parts of LUFA the keyboard and pipe personalities and their
+	descriptors use. Endpoint and device state functions are implemented by the USB
+	model in usbsim.c. */
+#ifndef EMU_LUFA_USB_H
+#define EMU_LUFA_USB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+// Device
+enum USB_Device_States_t
+{
+	DEVICE_STATE_Unattached = 0,
+	DEVICE_STATE_Powered    = 1,
+	DEVICE_STATE_Default    = 2,
+	DEVICE_STATE_Addressed  = 3,
+	DEVICE_STATE_Configured = 4,
+	DEVICE_STATE_Suspended  = 5,
+};
+
+typedef struct
+{
+	uint8_t  bmRequestType;
+	uint8_t  bRequest;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+} USB_Request_Header_t;
+
+extern volatile uint8_t USB_DeviceState;
+extern USB_Request_Header_t USB_ControlRequest;
+extern bool USB_Device_RemoteWakeupEnabled;
+
+void USB_Init(void);
+void USB_Disable(void);
+void USB_USBTask(void);
+void USB_Device_EnableSOFEvents(void);
+void USB_Device_DisableSOFEvents(void);
+void USB_Device_SendRemoteWakeup(void);
+
+// Descriptors
+typedef struct
+{
+	uint8_t Size;
+	uint8_t Type;
+} __attribute__((packed)) USB_Descriptor_Header_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint16_t USBSpecification;
+	uint8_t  Class;
+	uint8_t  SubClass;
+	uint8_t  Protocol;
+	uint8_t  Endpoint0Size;
+	uint16_t VendorID;
+	uint16_t ProductID;
+	uint16_t ReleaseNumber;
+	uint8_t  ManufacturerStrIndex;
+	uint8_t  ProductStrIndex;
+	uint8_t  SerialNumStrIndex;
+	uint8_t  NumberOfConfigurations;
+} __attribute__((packed)) USB_Descriptor_Device_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint16_t TotalConfigurationSize;
+	uint8_t  TotalInterfaces;
+	uint8_t  ConfigurationNumber;
+	uint8_t  ConfigurationStrIndex;
+	uint8_t  ConfigAttributes;
+	uint8_t  MaxPowerConsumption;
+} __attribute__((packed)) USB_Descriptor_Configuration_Header_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint8_t InterfaceNumber;
+	uint8_t AlternateSetting;
+	uint8_t TotalEndpoints;
+	uint8_t Class;
+	uint8_t SubClass;
+	uint8_t Protocol;
+	uint8_t InterfaceStrIndex;
+} __attribute__((packed)) USB_Descriptor_Interface_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint8_t  EndpointAddress;
+	uint8_t  Attributes;
+	uint16_t EndpointSize;
+	uint8_t  PollingIntervalMS;
+} __attribute__((packed)) USB_Descriptor_Endpoint_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint8_t FirstInterfaceIndex;
+	uint8_t TotalInterfaces;
+	uint8_t Class;
+	uint8_t SubClass;
+	uint8_t Protocol;
+	uint8_t IADStrIndex;
+} __attribute__((packed)) USB_Descriptor_Interface_Association_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint16_t HIDSpec;
+	uint8_t  CountryCode;
+	uint8_t  TotalReportDescriptors;
+	uint8_t  HIDReportType;
+	uint16_t HIDReportLength;
+} __attribute__((packed)) USB_HID_Descriptor_HID_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	wchar_t UnicodeString[]; // wider than on the device, Header.Size is the size on the bus
+} USB_Descriptor_String_t;
+
+#define DTYPE_Device				0x01
+#define DTYPE_Configuration			0x02
+#define DTYPE_String				0x03
+#define DTYPE_Interface				0x04
+#define DTYPE_Endpoint				0x05
+#define DTYPE_DeviceQualifier		0x06
+#define DTYPE_InterfaceAssociation	0x0B
+
+#define NO_DESCRIPTOR			0
+#define USE_INTERNAL_SERIAL		0xDC
+#define LANGUAGE_ID_ENG			0x0409
+#define VERSION_BCD(Major, Minor, Revision) \
+	((((Major) & 0xFF) << 8) | (((Minor) & 0x0F) << 4) | ((Revision) & 0x0F))
+
+#define USB_STRING_LEN(UnicodeChars)	(sizeof(USB_Descriptor_Header_t) + ((UnicodeChars) << 1))
+#define USB_STRING_DESCRIPTOR(String) \
+	{ .Header = {.Size = USB_STRING_LEN(sizeof(String) / sizeof(wchar_t) - 1), .Type = DTYPE_String}, .UnicodeString = String }
+#define USB_STRING_DESCRIPTOR_ARRAY(...) \
+	{ .Header = {.Size = USB_STRING_LEN(sizeof((uint16_t[]){__VA_ARGS__}) / 2), .Type = DTYPE_String}, .UnicodeString = {__VA_ARGS__} }
+
+#define USB_CONFIG_ATTR_RESERVED		0x80
+#define USB_CONFIG_ATTR_SELFPOWERED		0x40
+#define USB_CONFIG_ATTR_REMOTEWAKEUP	0x20
+#define USB_CONFIG_POWER_MA(mA)			((mA) >> 1)
+
+#define USB_CSCP_NoDeviceClass			0x00
+#define USB_CSCP_NoDeviceSubclass		0x00
+#define USB_CSCP_NoDeviceProtocol		0x00
+#define USB_CSCP_IADDeviceClass			0xEF
+#define USB_CSCP_IADDeviceSubclass		0x02
+#define USB_CSCP_IADDeviceProtocol		0x01
+
+#define ENDPOINT_ATTR_NO_SYNC	(0 << 2)
+#define ENDPOINT_USAGE_DATA		(0 << 4)
+
+#define FIXED_CONTROL_ENDPOINT_SIZE	8
+#define FIXED_NUM_CONFIGURATIONS	1
+
+// Standard requests
+#define REQ_GetStatus			0
+#define REQ_ClearFeature		1
+#define REQ_SetFeature			3
+#define REQ_SetAddress			5
+#define REQ_GetDescriptor		6
+#define REQ_GetConfiguration	8
+#define REQ_SetConfiguration	9
+
+#define FEATURE_SEL_DeviceRemoteWakeup	0x01
+#define REQDIR_HOSTTODEVICE	(0 << 7)
+#define REQDIR_DEVICETOHOST	(1 << 7)
+#define REQTYPE_STANDARD	(0 << 5)
+#define REQTYPE_CLASS		(1 << 5)
+#define REQTYPE_VENDOR		(2 << 5)
+#define REQREC_DEVICE		(0 << 0)
+#define REQREC_INTERFACE	(1 << 0)
+#define REQREC_ENDPOINT		(2 << 0)
+
+// Endpoints
+#define ENDPOINT_DIR_OUT	0x00
+#define ENDPOINT_DIR_IN		0x80
+#define ENDPOINT_CONTROLEP	0
+
+#define EP_TYPE_CONTROL		0x00
+#define EP_TYPE_ISOCHRONOUS	0x01
+#define EP_TYPE_BULK		0x02
+#define EP_TYPE_INTERRUPT	0x03
+
+bool Endpoint_ConfigureEndpoint(const uint8_t Address, const uint8_t Type, const uint16_t Size, const uint8_t Banks);
+void Endpoint_SelectEndpoint(const uint8_t Address);
+uint8_t Endpoint_GetCurrentEndpoint(void);
+bool Endpoint_IsReadWriteAllowed(void);
+bool Endpoint_IsINReady(void);
+bool Endpoint_IsOUTReceived(void);
+bool Endpoint_IsSETUPReceived(void);
+uint16_t Endpoint_BytesInEndpoint(void);
+void Endpoint_ClearIN(void);
+void Endpoint_ClearOUT(void);
+void Endpoint_ClearSETUP(void);
+void Endpoint_AbortPendingIN(void);
+void Endpoint_ClearStatusStage(void);
+void Endpoint_StallTransaction(void);
+uint8_t Endpoint_Read_8(void);
+void Endpoint_Write_8(const uint8_t Data);
+uint8_t Endpoint_Write_Stream_LE(const void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed);
+uint8_t Endpoint_Read_Stream_LE(void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed);
+uint8_t Endpoint_Write_Control_Stream_LE(const void* const Buffer, uint16_t Length);
+uint8_t Endpoint_Read_Control_Stream_LE(void* const Buffer, uint16_t Length);
+
+// CDC class
+#define CDC_CSCP_CDCClass				0x02
+#define CDC_CSCP_NoSpecificSubclass		0x00
+#define CDC_CSCP_ACMSubclass			0x02
+#define CDC_CSCP_NoSpecificProtocol		0x00
+#define CDC_CSCP_ATCommandProtocol		0x01
+#define CDC_CSCP_CDCDataClass			0x0A
+#define CDC_CSCP_NoDataSubclass			0x00
+#define CDC_CSCP_NoDataProtocol			0x00
+
+#define CDC_DTYPE_CSInterface				0x24
+#define CDC_DSUBTYPE_CSInterface_Header		0x00
+#define CDC_DSUBTYPE_CSInterface_ACM		0x02
+#define CDC_DSUBTYPE_CSInterface_Union		0x06
+
+#define CDC_REQ_SetLineEncoding		0x20
+#define CDC_REQ_GetLineEncoding		0x21
+#define CDC_REQ_SetControlLineState	0x22
+
+#define CDC_CONTROL_LINE_OUT_DTR	(1 << 0)
+#define CDC_CONTROL_LINE_OUT_RTS	(1 << 1)
+
+#define CDC_LINEENCODING_OneStopBit	0
+#define CDC_PARITY_None				0
+
+typedef struct
+{
+	uint32_t BaudRateBPS;
+	uint8_t  CharFormat;
+	uint8_t  ParityType;
+	uint8_t  DataBits;
+} __attribute__((packed)) CDC_LineEncoding_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint8_t  Subtype;
+	uint16_t CDCSpecification;
+} __attribute__((packed)) USB_CDC_Descriptor_FunctionalHeader_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint8_t Subtype;
+	uint8_t Capabilities;
+} __attribute__((packed)) USB_CDC_Descriptor_FunctionalACM_t;
+
+typedef struct
+{
+	USB_Descriptor_Header_t Header;
+	uint8_t Subtype;
+	uint8_t MasterInterfaceNumber;
+	uint8_t SlaveInterfaceNumber;
+} __attribute__((packed)) USB_CDC_Descriptor_FunctionalUnion_t;
+
+// HID class
+#define HID_CSCP_HIDClass				0x03
+#define HID_CSCP_NonBootSubclass		0x00
+#define HID_CSCP_BootSubclass			0x01
+#define HID_CSCP_NonBootProtocol		0x00
+#define HID_CSCP_KeyboardBootProtocol	0x01
+
+#define HID_DTYPE_HID		0x21
+#define HID_DTYPE_Report	0x22
+
+// report items, encoded as LUFA does
+typedef uint8_t USB_Descriptor_HIDReport_Datatype_t;
+
+#define HID_RI_DATA_BITS_0	0x00
+#define HID_RI_DATA_BITS_8	0x01
+#define HID_RI_DATA_BITS_16	0x02
+#define HID_RI_DATA_BITS_32	0x03
+#define _HID_RI_ENCODE_0(Data)
+#define _HID_RI_ENCODE_8(Data)	, ((Data) & 0xFF)
+#define _HID_RI_ENCODE_16(Data)	_HID_RI_ENCODE_8(Data) _HID_RI_ENCODE_8((Data) >> 8)
+#define _HID_RI_ENCODE_32(Data)	_HID_RI_ENCODE_16(Data) _HID_RI_ENCODE_16((Data) >> 16)
+#define _HID_RI_ENCODE(DataBits, ...)	_HID_RI_ENCODE_ ## DataBits(__VA_ARGS__)
+#define _HID_RI_ENTRY(Type, Tag, DataBits, ...) \
+	((Type) | (Tag) | HID_RI_DATA_BITS_ ## DataBits) _HID_RI_ENCODE(DataBits, (__VA_ARGS__))
+
+#define HID_RI_INPUT(DataBits, ...)				_HID_RI_ENTRY(0x00, 0x80, DataBits, __VA_ARGS__)
+#define HID_RI_OUTPUT(DataBits, ...)			_HID_RI_ENTRY(0x00, 0x90, DataBits, __VA_ARGS__)
+#define HID_RI_COLLECTION(DataBits, ...)		_HID_RI_ENTRY(0x00, 0xA0, DataBits, __VA_ARGS__)
+#define HID_RI_FEATURE(DataBits, ...)			_HID_RI_ENTRY(0x00, 0xB0, DataBits, __VA_ARGS__)
+#define HID_RI_END_COLLECTION(DataBits, ...)	_HID_RI_ENTRY(0x00, 0xC0, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE_PAGE(DataBits, ...)		_HID_RI_ENTRY(0x04, 0x00, DataBits, __VA_ARGS__)
+#define HID_RI_LOGICAL_MINIMUM(DataBits, ...)	_HID_RI_ENTRY(0x04, 0x10, DataBits, __VA_ARGS__)
+#define HID_RI_LOGICAL_MAXIMUM(DataBits, ...)	_HID_RI_ENTRY(0x04, 0x20, DataBits, __VA_ARGS__)
+#define HID_RI_REPORT_SIZE(DataBits, ...)		_HID_RI_ENTRY(0x04, 0x70, DataBits, __VA_ARGS__)
+#define HID_RI_REPORT_ID(DataBits, ...)			_HID_RI_ENTRY(0x04, 0x80, DataBits, __VA_ARGS__)
+#define HID_RI_REPORT_COUNT(DataBits, ...)		_HID_RI_ENTRY(0x04, 0x90, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE(DataBits, ...)				_HID_RI_ENTRY(0x08, 0x00, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE_MINIMUM(DataBits, ...)		_HID_RI_ENTRY(0x08, 0x10, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE_MAXIMUM(DataBits, ...)		_HID_RI_ENTRY(0x08, 0x20, DataBits, __VA_ARGS__)
+
+#define HID_IOF_CONSTANT		(1 << 0)
+#define HID_IOF_DATA			(0 << 0)
+#define HID_IOF_VARIABLE		(1 << 1)
+#define HID_IOF_ARRAY			(0 << 1)
+#define HID_IOF_RELATIVE		(1 << 2)
+#define HID_IOF_ABSOLUTE		(0 << 2)
+#define HID_IOF_NON_VOLATILE	(0 << 7)
+#define HID_IOF_VOLATILE		(1 << 7)
+
+#define HID_REQ_GetReport	0x01
+#define HID_REQ_GetIdle		0x02
+#define HID_REQ_GetProtocol	0x03
+#define HID_REQ_SetReport	0x09
+#define HID_REQ_SetIdle		0x0A
+#define HID_REQ_SetProtocol	0x0B
+
+typedef struct
+{
+	uint8_t Modifier;
+	uint8_t Reserved;
+	uint8_t KeyCode[6];
+} USB_KeyboardReport_Data_t;
+
+#define HID_KEYBOARD_MODIFIER_LEFTCTRL		(1 << 0)
+#define HID_KEYBOARD_MODIFIER_LEFTSHIFT		(1 << 1)
+#define HID_KEYBOARD_MODIFIER_LEFTALT		(1 << 2)
+#define HID_KEYBOARD_MODIFIER_LEFTGUI		(1 << 3)
+#define HID_KEYBOARD_MODIFIER_RIGHTCTRL		(1 << 4)
+#define HID_KEYBOARD_MODIFIER_RIGHTSHIFT	(1 << 5)
+#define HID_KEYBOARD_MODIFIER_RIGHTALT		(1 << 6)
+#define HID_KEYBOARD_MODIFIER_RIGHTGUI		(1 << 7)
+
+#define HID_KEYBOARD_LED_NUMLOCK	(1 << 0)
+#define HID_KEYBOARD_LED_CAPSLOCK	(1 << 1)
+#define HID_KEYBOARD_LED_SCROLLLOCK	(1 << 2)
+
+#define HID_KEYBOARD_SC_A					0x04
+#define HID_KEYBOARD_SC_1_AND_EXCLAMATION	0x1E
+#define HID_KEYBOARD_SC_ENTER				0x28
+#define HID_KEYBOARD_SC_ESCAPE				0x29
+#define HID_KEYBOARD_SC_BACKSPACE			0x2A
+#define HID_KEYBOARD_SC_TAB					0x2B
+#define HID_KEYBOARD_SC_SPACE				0x2C
+#define HID_KEYBOARD_SC_CAPS_LOCK			0x39
+
+#endif
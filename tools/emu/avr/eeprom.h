@@ -0,0 +1,17 @@
+/* Host stand-in for avr/eeprom.h, backed by an in-memory image in pwemu.c */
+#ifndef EMU_AVR_EEPROM_H
+#define EMU_AVR_EEPROM_H
+
+#include <avr/io.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t* p);
+uint16_t eeprom_read_word(const uint16_t* p);
+uint32_t eeprom_read_dword(const uint32_t* p);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+void eeprom_update_byte(uint8_t* p, uint8_t v);
+void eeprom_update_word(uint16_t* p, uint16_t v);
+void eeprom_update_block(const void* src, void* dst, size_t n);
+
+#endif
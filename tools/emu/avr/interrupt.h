@@ -0,0 +1,10 @@
+/* Host stand-in for avr/interrupt.h, the emulator is single threaded. */
+#ifndef EMU_AVR_INTERRUPT_H
+#define EMU_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define cli()
+#define sei()
+
+#endif
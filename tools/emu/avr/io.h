@@ -0,0 +1,29 @@
+/* Host stand-in for avr/io.h, just what the shared firmware sources use. */
+#ifndef EMU_AVR_IO_H
+#define EMU_AVR_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define _BV(b) (1 << (b))
+
+#define E2END 0x3FF	/* atmega32u2 */
+
+extern uint8_t SREG;
+extern uint16_t EEAR;
+extern uint8_t EEDR;
+
+/* port registers, in the device's order so main.h's DDR() and PIN() find theirs */
+extern uint8_t avrsim_io[9];
+#define PINB	avrsim_io[0]
+#define DDRB	avrsim_io[1]
+#define PORTB	avrsim_io[2]
+#define PINC	avrsim_io[3]
+#define DDRC	avrsim_io[4]
+#define PORTC	avrsim_io[5]
+#define PIND	avrsim_io[6]
+#define DDRD	avrsim_io[7]
+#define PORTD	avrsim_io[8]
+
+#endif
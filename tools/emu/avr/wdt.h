@@ -0,0 +1,18 @@
+/* Host stand-in for avr/wdt.h */
+#ifndef EMU_AVR_WDT_H
+#define EMU_AVR_WDT_H
+
+#define WDTO_15MS	0
+#define WDTO_30MS	1
+#define WDTO_60MS	2
+#define WDTO_120MS	3
+#define WDTO_250MS	4
+#define WDTO_500MS	5
+#define WDTO_1S		6
+#define WDTO_2S		7
+
+#define wdt_reset()
+#define wdt_enable(t)
+#define wdt_disable()
+
+#endif
@@ -0,0 +1,191 @@
+/**
+password typist
+
+@file		avrsim.c
+@brief		Host side eeprom image, scheduler, clock and rng stand-ins shared by the emulators.
+@author		Matej Kogovsek
+@copyright	GPL v2
+*/
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avr/eeprom.h>
+
+#include "avrsim.h"
+#include "sched.h"
+#include "rtc.h"
+#include "rng.h"
+#include "main.h"
+
+uint8_t SREG;
+uint16_t EEAR;
+uint8_t EEDR;
+uint8_t avrsim_io[9];
+
+uint8_t avrsim_eeprom[E2END + 1];
+unsigned avrsim_eeprom_write_us = 3400; // erase and write time of one byte
+void (*avrsim_eeprom_writing)(void) = NULL;
+
+// eeprom image
+
+uint8_t eeprom_read_byte(const uint8_t* p)
+{
+	return avrsim_eeprom[(uintptr_t)p & E2END];
+}
+
+uint16_t eeprom_read_word(const uint16_t* p)
+{
+	uint16_t r;
+	eeprom_read_block(&r, p, sizeof(r));
+	return r;
+}
+
+uint32_t eeprom_read_dword(const uint32_t* p)
+{
+	uint32_t r;
+	eeprom_read_block(&r, p, sizeof(r));
+	return r;
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+	uint8_t* d = dst;
+	uintptr_t a = (uintptr_t)src;
+	while( n-- ) *d++ = avrsim_eeprom[a++ & E2END];
+}
+
+void eeprom_update_byte(uint8_t* p, uint8_t v)
+{
+	uintptr_t a = (uintptr_t)p & E2END;
+	if( avrsim_eeprom[a] == v ) return;
+	if( avrsim_eeprom_writing ) avrsim_eeprom_writing();
+	if( avrsim_eeprom_write_us ) usleep(avrsim_eeprom_write_us);
+	avrsim_eeprom[a] = v;
+}
+
+void eeprom_update_word(uint16_t* p, uint16_t v)
+{
+	eeprom_update_block(&v, p, sizeof(v));
+}
+
+void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+	const uint8_t* s = src;
+	uint8_t* d = dst;
+	while( n-- ) eeprom_update_byte(d++, *s++);
+}
+
+void eeprom_erase(void)
+{
+	uint16_t ea;
+	for( ea = 0; ea <= E2END; ++ea ) eeprom_update_byte((uint8_t*)(uintptr_t)ea, 0);
+}
+
+// scheduler, the emulators drive the tasks themselves
+
+void sched_init(void)
+{
+}
+
+uint8_t sched_add(const char* name, void (*fn)(void), const uint8_t events, const uint8_t deadline)
+{
+	(void)name; (void)fn; (void)events; (void)deadline;
+	return 0;
+}
+
+void sched_post(const uint8_t ev)
+{
+	(void)ev;
+}
+
+uint8_t avrsim_suspended = 0;
+uint8_t avrsim_powerdown = 0;
+
+void sched_suspend(const uint8_t on)
+{
+	uint32_t t;
+	avrsim_suspended = on;
+	avrsim_powerdown = on && !rtc_get(&t); // as sched.c picks the sleep mode
+}
+
+void sched_sof(void)
+{
+}
+
+uint8_t sched_irq_latency(void)
+{
+	return 0;
+}
+
+void sched_feed(void)
+{
+}
+
+uint16_t (*avrsim_now)(void) = NULL;
+
+uint16_t sched_now(void)
+{
+	if( avrsim_now ) return avrsim_now();
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 125000 + ts.tv_nsec / 8000; // 8 us timer0 counts
+}
+
+const struct sched_task_t* sched_get(const uint8_t i)
+{
+	(void)i;
+	return NULL;
+}
+
+uint8_t sched_trap_get(struct sched_trap_t* tr)
+{
+	(void)tr;
+	return 0;
+}
+
+void sched_run(void)
+{
+	while( 1 ) pause();
+}
+
+// clock, from the host's
+
+static long rtc_off;
+static uint8_t rtc_valid = 0;
+
+void rtc_init(const uint8_t keep)
+{
+	rtc_valid = keep && rtc_valid;
+}
+
+void rtc_set(const uint32_t t)
+{
+	rtc_off = (long)t - time(NULL);
+	rtc_valid = 1;
+}
+
+uint8_t rtc_get(uint32_t* t)
+{
+	*t = time(NULL) + rtc_off;
+	return rtc_valid;
+}
+
+// random bytes, from the host's
+
+uint16_t rng_seed(uint16_t* hist)
+{
+	(void)hist;
+	return 0;
+}
+
+uint8_t rng_byte(void)
+{
+	static int fd = -1;
+	uint8_t b = 0;
+	if( fd < 0 ) fd = open("/dev/urandom", O_RDONLY);
+	if( read(fd, &b, 1) != 1 ) b = 0;
+	return b;
+}
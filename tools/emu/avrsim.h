@@ -0,0 +1,13 @@
+#ifndef AVRSIM_H
+#define AVRSIM_H
+
+#include <avr/io.h>
+
+extern uint8_t avrsim_eeprom[E2END + 1];
+extern unsigned avrsim_eeprom_write_us; // time per changed byte, 0 for none
+extern void (*avrsim_eeprom_writing)(void); // called before each changed byte, where an interrupt could cut in
+extern uint8_t avrsim_suspended; // sched_suspend state, the watchdog ticks every 16 ms then
+extern uint8_t avrsim_powerdown; // sleeping in power down while suspended, idle otherwise
+extern uint16_t (*avrsim_now)(void); // sched_now, for an emulator on frame time rather than the host clock
+
+#endif
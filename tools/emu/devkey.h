@@ -0,0 +1,2 @@
+/* Fixed device key for the emulators, used when no devkey.h was generated in the repository root. */
+#define DEVKEY 0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f
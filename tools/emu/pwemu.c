@@ -0,0 +1,185 @@
+/**
+password typist
+
+@file		pwemu.c
+@brief		Host emulator of a device in setup mode (address 0), on a pseudo terminal.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build (from the repository root):
+	cc -std=gnu99 -O2 -Wno-int-to-pointer-cast -Itools/emu -I. -o pwemu \
+		tools/emu/pwemu.c tools/emu/avrsim.c ser.c sha1.c totp.c xtea.c slot.c layout.c
+
+Usage: pwemu [-n count] [-l linkprefix] [-f]
+
+The command parser and slot storage are the firmware's own ser.c, compiled for
+the host against the stand-in avr headers in this directory. EEPROM is the
+in-memory image in avrsim.c, where every changed byte costs the device's erase
+and write time. Data moves in CDC_TXRX_EPSIZE packets, at most one per direction per
+1 ms frame, through 64 byte queues like the firmware's, and a reply blocks
+the parser while the transmit queue is full.
+
+Each emulated device runs in its own process. The pty paths are printed one
+per line; with -l, symlinks linkprefix0, linkprefix1, ... are made as well.
+-f runs just one device in the foreground.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "avrsim.h"
+#include "ser.h"
+#include "main.h"
+
+#define QUEUE_SIZE SER_RING_SIZE // as txbuf and rxbuf in s_main.c
+#define FRAME_NS 1000000L // USB full speed frame
+
+static int master = -1;
+static struct timespec next_frame;
+
+static uint8_t txq[QUEUE_SIZE];
+static uint8_t txlen = 0;
+static uint8_t rxq[QUEUE_SIZE];
+static uint8_t rxlen = 0;
+
+// USB frame: one IN and one OUT packet at most
+
+static void frame(void)
+{
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_frame, NULL);
+	next_frame.tv_nsec += FRAME_NS;
+	if( next_frame.tv_nsec >= 1000000000L ) {
+		next_frame.tv_nsec -= 1000000000L;
+		++next_frame.tv_sec;
+	}
+
+	if( txlen ) {
+		ssize_t n = write(master, txq, (txlen < CDC_TXRX_EPSIZE) ? txlen : CDC_TXRX_EPSIZE);
+		if( n > 0 ) {
+			memmove(txq, txq + n, txlen - n);
+			txlen -= n;
+		}
+	}
+
+	// the firmware NAKs the host until a whole packet fits
+	if( QUEUE_SIZE - rxlen >= CDC_TXRX_EPSIZE ) {
+		ssize_t n = read(master, rxq + rxlen, CDC_TXRX_EPSIZE);
+		if( n > 0 ) rxlen += n;
+	}
+}
+
+uint8_t Serial_SendByte(uint8_t a)
+{
+	while( txlen >= QUEUE_SIZE ) frame();
+	txq[txlen++] = a;
+	return 1;
+}
+
+// there are no dip switches to restart into, r! answers err
+uint8_t Sw_Restart(void)
+{
+	return 0;
+}
+
+static void run(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &next_frame);
+
+	while( 1 ) {
+		frame();
+
+		// Ser_ProcessByte may run frames itself while replying, so take bytes out first
+		uint8_t b[QUEUE_SIZE];
+		uint8_t i, n = rxlen;
+		memcpy(b, rxq, n);
+		rxlen = 0;
+		for( i = 0; i < n; ++i ) Ser_ProcessByte(b[i]);
+	}
+}
+
+// opens a pty in raw mode, returns slave path
+static const char* open_pty(void)
+{
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if( (master < 0) || grantpt(master) || unlockpt(master) ) {
+		perror("pty");
+		exit(1);
+	}
+
+	const char* path = ptsname(master);
+
+	// keep the slave open ourselves, so the master doesn't read EIO while no client has it open
+	int slave = open(path, O_RDWR | O_NOCTTY);
+	struct termios t;
+	if( (slave >= 0) && (tcgetattr(slave, &t) == 0) ) {
+		cfmakeraw(&t);
+		tcsetattr(slave, TCSANOW, &t);
+	}
+
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+	return path;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pwemu [-n count] [-l linkprefix] [-f]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int count = 1;
+	const char* link = NULL;
+	int fg = 0;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "n:l:f")) != -1 ) {
+		switch( opt ) {
+			case 'n': count = atoi(optarg); break;
+			case 'l': link = optarg; break;
+			case 'f': fg = 1; break;
+			default: usage();
+		}
+	}
+	if( (count < 1) || (fg && (count != 1)) ) usage();
+
+	int i;
+	for( i = 0; i < count; ++i ) {
+		int p[2];
+		if( !fg && pipe(p) ) { perror("pipe"); return 1; }
+
+		if( fg || (fork() == 0) ) {
+			const char* path = open_pty();
+			if( link ) {
+				char ln[256];
+				snprintf(ln, sizeof(ln), "%s%d", link, i);
+				unlink(ln);
+				if( symlink(path, ln) ) perror(ln);
+			}
+			printf("%s\n", path);
+			fflush(stdout);
+			if( !fg ) { close(p[0]); close(p[1]); } // tell the parent we're ready
+			run();
+		}
+
+		// wait for the child's pty, so paths are printed in order
+		char c;
+		close(p[1]);
+		if( read(p[0], &c, 1) < 0 ) {}
+		close(p[0]);
+	}
+
+	signal(SIGINT, SIG_IGN); // children get it too and exit
+	while( wait(NULL) > 0 );
+	return 0;
+}
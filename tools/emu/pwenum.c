@@ -0,0 +1,391 @@
+/**
+password typist
+
+@file		pwenum.c
+@brief		Replays recorded host enumerations against the keyboard personality and times its startup.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build (from the repository root):
+	cc -std=gnu99 -O2 -Wno-int-to-pointer-cast -Itools/emu -I. -o pwenum \
+		tools/emu/pwenum.c tools/emu/usbsim.c tools/emu/avrsim.c k_main.c k_descriptors.c \
+		sha1.c totp.c xtea.c slot.c layout.c
+
+Usage: pwenum [-s slack_ms] [-v] capture.usbmon
+
+The capture is usbmon text, as read from /sys/kernel/debug/usb/usbmon/<bus>u,
+of the keyboard from the bus reset on. Lines starting with # are comments.
+Control submissions (S Ci/Co) are replayed at their recorded times, 1000 us of
+the capture to a 1 ms frame. They go to k_EVENT_USB_Device_ControlRequest
+first, and the ones it leaves to the library to a stand-in for LUFA's standard
+request handling, which takes descriptors from k_CALLBACK_USB_GetDescriptor.
+The device has to answer each request as its recorded completion (C) says:
+stalled for status -32, accepted otherwise. The first interrupt IN submission
+(S Ii) starts the host polling the keyboard endpoint at the interval recorded
+with it.
+
+Ready is when the host is done with the capture, at its last control transfer
+or its first poll, whichever is later. First key is when the host takes the
+first report with a key pressed. Both count from the first line. The slot
+holds TEST_TEXT, which has to come out in full, decoded with the host's caps
+lock as set by the capture's LED reports.
+
+A "# expect ready <ms> key <ms>" line in the capture sets limits. Going over
+either by more than slack_ms (2 by default) is a regression, and so are a
+wrong answer to a request and wrong text. -v prints every replayed request.
+Exit status is 0 when there's none.
+*/
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "avrsim.h"
+#include "usbsim.h"
+#include "k_descriptors.h"
+#include "slot.h"
+#include "sched.h"
+#include "main.h"
+
+#define MAX_XFERS 256
+#define MAX_FRAMES 10000
+#define TEST_TEXT "Hello, World!"
+#define INTERNAL_SERIAL_SIZE 42 // LUFA's serial number string, 20 hex digits of the signature row
+
+void LoadSlot(const uint8_t n);
+void HID_Task(void);
+void TOTP_Task(void);
+void Check_Task(void);
+uint8_t c2ksc(const char c, uint8_t* ksc, uint8_t* mod);
+
+uint8_t getswi(void)
+{
+	return 1;
+}
+
+uint8_t readswi(void)
+{
+	return 1;
+}
+
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	k_EVENT_USB_Device_StartOfFrame();
+}
+
+void EVENT_USB_Device_Suspend(void)
+{
+	sched_suspend(1);
+}
+
+void EVENT_USB_Device_WakeUp(void)
+{
+	sched_suspend(0);
+}
+
+struct xfer_t
+{
+	unsigned long t; // us from the first line
+	char tag[32]; // usbmon urb tag, pairs a submission with its completion
+	char type; // 'C' control, 'I' interrupt
+	USB_Request_Header_t req;
+	uint8_t data[64]; // OUT data stage
+	int status; // recorded completion status, 1 if none
+	int interval; // polling interval of an interrupt submission, frames
+};
+
+static struct xfer_t xfers[MAX_XFERS];
+static int nxfers = 0;
+static long expect_ready = -1, expect_key = -1;
+static int verbose = 0;
+
+// Reads the usbmon text capture.
+static int load(const char* fn)
+{
+	FILE* f = fopen(fn, "r");
+	if( !f ) { perror(fn); return 0; }
+
+	char line[512];
+	unsigned long t0 = 0;
+	int ln = 0;
+	while( fgets(line, sizeof(line), f) ) {
+		++ln;
+		if( line[0] == '#' ) {
+			sscanf(line, "# expect ready %ld key %ld", &expect_ready, &expect_key);
+			continue;
+		}
+
+		char tag[32], ev, addr[32];
+		unsigned long t;
+		int pos;
+		if( sscanf(line, "%31s %lu %c %31s %n", tag, &t, &ev, addr, &pos) < 4 ) continue;
+		if( !nxfers ) t0 = t;
+		char* rest = line + pos;
+
+		if( ev == 'C' ) { // completion, status of its submission
+			int i;
+			for( i = nxfers - 1; i >= 0; --i ) {
+				if( !strcmp(xfers[i].tag, tag) && (xfers[i].status == 1) ) {
+					xfers[i].status = atoi(rest);
+					break;
+				}
+			}
+			continue;
+		}
+		if( (ev != 'S') || (nxfers == MAX_XFERS) ) continue;
+
+		struct xfer_t* x = &xfers[nxfers];
+		memset(x, 0, sizeof(*x));
+		strcpy(x->tag, tag);
+		x->t = t - t0;
+		x->type = addr[0];
+		x->status = 1;
+
+		if( x->type == 'I' ) {
+			if( (addr[1] != 'i') || sscanf(rest, "%*d:%d", &x->interval) != 1 || (x->interval < 1) ) continue;
+		} else
+		if( x->type == 'C' ) {
+			unsigned bm, br, wv, wi, wl;
+			if( sscanf(rest, "s %x %x %x %x %x %n", &bm, &br, &wv, &wi, &wl, &pos) < 5 ) {
+				fprintf(stderr, "%s:%d: control submission without setup packet\n", fn, ln);
+				fclose(f);
+				return 0;
+			}
+			x->req.bmRequestType = bm;
+			x->req.bRequest = br;
+			x->req.wValue = wv;
+			x->req.wIndex = wi;
+			x->req.wLength = wl;
+
+			// OUT data: length, then = and the bytes in groups of up to four
+			char* d = strchr(rest + pos, '=');
+			int n = 0;
+			while( d && *d && (n < (int)sizeof(x->data)) ) {
+				unsigned v;
+				if( isxdigit(d[0]) && isxdigit(d[1]) && (sscanf(d, "%2x", &v) == 1) ) {
+					x->data[n++] = v;
+					d += 2;
+				} else {
+					++d;
+				}
+			}
+		} else {
+			continue;
+		}
+		++nxfers;
+	}
+
+	fclose(f);
+	return 1;
+}
+
+// Standard requests, as LUFA serves them once the device's handler has passed. -1 stalls.
+static int std_request(const USB_Request_Header_t* r)
+{
+	if( (r->bmRequestType & (3 << 5)) != REQTYPE_STANDARD ) return -1;
+
+	switch( r->bRequest ) {
+		case REQ_GetDescriptor: {
+			uint16_t size;
+			if( ((r->wValue >> 8) == DTYPE_String) && ((r->wValue & 0xff) == USE_INTERNAL_SERIAL) ) {
+				size = INTERNAL_SERIAL_SIZE;
+			} else {
+				const void* a;
+				size = k_CALLBACK_USB_GetDescriptor(r->wValue, r->wIndex, &a);
+				if( size == NO_DESCRIPTOR ) return -1;
+			}
+			return (size < r->wLength) ? size : r->wLength;
+		}
+		case REQ_SetAddress:
+			USB_DeviceState = DEVICE_STATE_Addressed;
+			return 0;
+		case REQ_SetConfiguration:
+			if( r->wValue > FIXED_NUM_CONFIGURATIONS ) return -1;
+			if( r->wValue ) {
+				usbsim_configure(k_EVENT_USB_Device_ConfigurationChanged);
+			} else {
+				USB_DeviceState = DEVICE_STATE_Addressed;
+			}
+			return 0;
+		case REQ_GetConfiguration:
+			return 1;
+		case REQ_GetStatus:
+			return 2;
+		case REQ_SetFeature:
+		case REQ_ClearFeature:
+			if( ((r->bmRequestType & 0x1f) == REQREC_DEVICE) && (r->wValue == FEATURE_SEL_DeviceRemoteWakeup) ) {
+				USB_Device_RemoteWakeupEnabled = (r->bRequest == REQ_SetFeature);
+			}
+			return 0;
+	}
+
+	return -1;
+}
+
+// typed characters
+static char text[256];
+static unsigned long when[256];
+static int ntext = 0;
+static uint8_t hostleds = 0;
+
+static char decode(const uint8_t usage, const uint8_t mod)
+{
+	if( !mod && (usage == HID_KEYBOARD_SC_TAB) ) return '\t';
+	if( !mod && (usage == HID_KEYBOARD_SC_ENTER) ) return '\r';
+
+	int i;
+	for( i = 32; i < 127; ++i ) {
+		uint8_t k, m;
+		if( c2ksc(i, &k, &m) && (k == usage) && (m == mod) ) return i;
+	}
+
+	return '?';
+}
+
+static void press(const uint8_t usage, const uint8_t mod)
+{
+	static int dead = 0;
+	if( usage == HID_KEYBOARD_SC_CAPS_LOCK ) {
+		hostleds ^= HID_KEYBOARD_LED_CAPSLOCK;
+		return;
+	}
+
+	char c = decode(usage, mod);
+	if( (hostleds & HID_KEYBOARD_LED_CAPSLOCK) && (((c | 0x20) >= 'a') && ((c | 0x20) <= 'z')) ) c ^= 0x20;
+
+	uint8_t k, m;
+	if( dead && (c == ' ') ) { dead = 0; return; } // completes the dead key
+	dead = (c2ksc(c, &k, &m) == 2);
+
+	if( ntext < (int)sizeof(text) - 1 ) {
+		text[ntext] = c;
+		when[ntext] = usbsim_frame_no;
+		++ntext;
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pwenum [-s slack_ms] [-v] capture.usbmon\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int slack = 2;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "s:v")) != -1 ) {
+		switch( opt ) {
+			case 's': slack = atoi(optarg); break;
+			case 'v': verbose = 1; break;
+			default: usage();
+		}
+	}
+	if( optind != argc - 1 ) usage();
+	const char* fn = argv[optind];
+	if( !load(fn) ) return 2;
+
+	uint8_t b[PWD_SIZE] = {0};
+	memcpy(b, TEST_TEXT, strlen(TEST_TEXT));
+	avrsim_eeprom_write_us = 0;
+	slot_write(1, b);
+	LoadSlot(1);
+
+	usbsim_reset();
+
+	int errors = 0;
+	int next = 0; // next transfer to replay
+	int poll = 0; // host polling interval, 0 before the first interrupt submission
+	unsigned long ready = 0;
+	USB_KeyboardReport_Data_t prev;
+	memset(&prev, 0, sizeof(prev));
+
+	while( usbsim_frame_no < MAX_FRAMES ) {
+		for( ; (next < nxfers) && (xfers[next].t <= usbsim_frame_no * 1000UL); ++next ) {
+			struct xfer_t* x = &xfers[next];
+			ready = usbsim_frame_no;
+
+			if( x->type == 'I' ) {
+				if( !poll ) poll = x->interval;
+				continue;
+			}
+
+			uint8_t data[64];
+			memcpy(data, x->data, sizeof(data));
+			int n = usbsim_control(&x->req, data, k_EVENT_USB_Device_ControlRequest);
+			if( n < 0 ) n = std_request(&x->req);
+			if( (n >= 0) && (x->req.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
+				&& (x->req.bRequest == HID_REQ_SetReport) ) {
+				hostleds = x->data[0];
+			}
+
+			if( verbose ) {
+				printf("%5lu ms  %02x %02x %04x %04x %04x  %s\n", usbsim_frame_no, x->req.bmRequestType, x->req.bRequest,
+					x->req.wValue, x->req.wIndex, x->req.wLength, (n < 0) ? "stall" : "ok");
+			}
+			if( (x->status != 1) && ((n < 0) != (x->status == -32)) ) {
+				printf("%s: request %02x %02x %04x %04x %s, the host saw it %s\n", fn, x->req.bmRequestType, x->req.bRequest,
+					x->req.wValue, x->req.wIndex, (n < 0) ? "stalled" : "accepted", (x->status == -32) ? "stalled" : "accepted");
+				++errors;
+			}
+		}
+
+		Check_Task();
+		TOTP_Task();
+		HID_Task();
+
+		if( poll && !(usbsim_frame_no % poll) ) {
+			USB_KeyboardReport_Data_t rep;
+			if( usbsim_in_poll(KEYBOARD_IN_EPADDR, (uint8_t*)&rep) == sizeof(rep) ) {
+				int i, j;
+				for( i = 0; i < 6; ++i ) {
+					if( !rep.KeyCode[i] ) continue;
+					for( j = 0; j < 6; ++j ) if( prev.KeyCode[j] == rep.KeyCode[i] ) break;
+					if( j == 6 ) press(rep.KeyCode[i], rep.Modifier);
+				}
+				prev = rep;
+			}
+		}
+
+		if( (next == nxfers) && (ntext >= (int)strlen(TEST_TEXT)) ) break;
+		usbsim_frame();
+	}
+
+	text[ntext] = 0;
+	if( !poll ) {
+		printf("%s: the host never polls the keyboard\n", fn);
+		++errors;
+	}
+	if( USB_DeviceState != DEVICE_STATE_Configured ) {
+		printf("%s: the device isn't configured\n", fn);
+		++errors;
+	}
+	if( strcmp(text, TEST_TEXT) ) {
+		printf("%s: typed \"%s\", expected \"%s\"\n", fn, text, TEST_TEXT);
+		++errors;
+	}
+
+	printf("%s: ready %lu ms", fn, ready);
+	if( expect_ready >= 0 ) printf(" (limit %ld)", expect_ready);
+	if( ntext ) {
+		printf(", first key %lu ms", when[0]);
+		if( expect_key >= 0 ) printf(" (limit %ld)", expect_key);
+	}
+	printf("\n");
+
+	if( (expect_ready >= 0) && ((long)ready > expect_ready + slack) ) {
+		printf("%s: REGRESSION, ready %ld ms later\n", fn, (long)ready - expect_ready);
+		++errors;
+	}
+	if( (expect_key >= 0) && ntext && ((long)when[0] > expect_key + slack) ) {
+		printf("%s: REGRESSION, first key %ld ms later\n", fn, (long)when[0] - expect_key);
+		++errors;
+	}
+
+	return errors ? 1 : 0;
+}
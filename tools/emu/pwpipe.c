@@ -0,0 +1,265 @@
+/**
+password typist
+
+@file		pwpipe.c
+@brief		Runs the typing pipe personality on the host and measures its rate and latency.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build (from the repository root):
+	cc -std=gnu99 -O2 -Wno-int-to-pointer-cast -Itools/emu -I. -o pwpipe \
+		tools/emu/pwpipe.c tools/emu/usbsim.c tools/emu/avrsim.c p_main.c circbuf8.c layout.c
+
+Usage: pwpipe [-b bps] [-l layout] [-i poll_ms] [-j percent] [-1] text|-
+
+p_main.c runs against the endpoint model in usbsim.c, one 1 ms frame at a
+time. The host sends the text (- reads stdin) in CDC_TXRX_EPSIZE packets, at
+most one per frame and only when the device takes it, and polls the keyboard
+endpoint every poll_ms frames (1, as in the endpoint descriptor, by default).
+-b sets the line speed with SET_LINE_CODING. The reports are decoded with the
+device layout and compared with the text.
+
+The sustained rate is taken from the first to the last key. Latency is counted
+per typed char, from the frame its packet was accepted to the frame the host
+took the report with its key, so with a full ring it includes the wait behind
+the chars ahead of it. -1 sends one char at a time, after the previous one
+was typed, for the latency of an idle pipe.
+
+Polls the device NAKs between the first and the last key are counted as gaps;
+at full rate each one is a frame without a key. -j makes the device task miss
+the given percentage of frames, as when another task runs long, to check that
+the double banked keyboard endpoint covers for it.
+
+Exit status is 0 when the decoded text matches.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "avrsim.h"
+#include "usbsim.h"
+#include "p_descriptors.h"
+#include "layout.h"
+#include "sched.h"
+#include "main.h"
+
+#define MAX_TEXT 65536
+#define MAX_FRAMES 10000000UL
+#define STALL_FRAMES 1000 // stop when nothing is typed for this long
+
+void p_Init(void);
+void Pipe_Task(void);
+
+uint8_t getswi(void)
+{
+	return 14;
+}
+
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	p_EVENT_USB_Device_StartOfFrame();
+}
+
+void EVENT_USB_Device_Suspend(void)
+{
+	sched_suspend(1);
+}
+
+void EVENT_USB_Device_WakeUp(void)
+{
+	sched_suspend(0);
+}
+
+uint8_t rxbuf[SER_RING_SIZE]; // in s_main.c on the device
+
+static uint8_t layout = 0;
+
+static char text[MAX_TEXT + 1];
+static int ntext = 0;
+static unsigned long sent[MAX_TEXT]; // frame each byte was accepted
+
+// typed keys, as chars
+static char typed[MAX_TEXT + 1];
+static unsigned long typed_at[MAX_TEXT];
+static int ntyped = 0;
+
+static char decode(const uint8_t usage, const uint8_t mod)
+{
+	if( !mod && (usage == HID_KEYBOARD_SC_TAB) ) return '\t';
+	if( !mod && (usage == HID_KEYBOARD_SC_ENTER) ) return '\r';
+
+	int i;
+	for( i = 32; i < 127; ++i ) {
+		uint8_t k, m;
+		if( layout_c2ksc(layout, i, &k, &m) && (k == usage) && (m == mod) ) return i;
+	}
+
+	return '?';
+}
+
+static void press(const uint8_t usage, const uint8_t mod)
+{
+	static int dead = 0;
+	char c = decode(usage, mod);
+
+	uint8_t k, m;
+	if( dead && (c == ' ') ) { dead = 0; return; } // completes the dead key
+	dead = (layout_c2ksc(layout, c, &k, &m) == 2);
+
+	if( ntyped < MAX_TEXT ) {
+		typed[ntyped] = c;
+		typed_at[ntyped] = usbsim_frame_no;
+		++ntyped;
+	}
+}
+
+// what the text should type, with the index of the byte each key comes from
+static int expected(char* exp, int* src)
+{
+	int i, n = 0;
+	for( i = 0; i < ntext; ++i ) {
+		char c = text[i];
+		uint8_t k, m;
+		if( (c == '\n') && i && (text[i - 1] == '\r') ) continue;
+		if( (c == '\r') || (c == '\n') ) c = '\r'; else
+		if( (c != '\t') && !layout_c2ksc(layout, c, &k, &m) ) continue;
+		src[n] = i;
+		exp[n++] = c;
+	}
+	exp[n] = 0;
+	return n;
+}
+
+static void print_text(const char* label, const char* s)
+{
+	printf("%s", label);
+	for( ; *s; ++s ) {
+		if( *s == '\t' ) printf("\\t"); else
+		if( *s == '\r' ) printf("\\r"); else
+		if( *s == '\n' ) printf("\\n"); else
+		putchar(*s);
+	}
+	printf("\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pwpipe [-b bps] [-l layout] [-i poll_ms] [-j percent] [-1] text|-\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t bps = 0;
+	int poll = 1;
+	int single = 0;
+	int jitter = 0;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "b:l:i:j:1")) != -1 ) {
+		switch( opt ) {
+			case 'b': bps = strtoul(optarg, NULL, 0); break;
+			case 'l': if( (layout = layout_find(optarg)) >= LAYOUT_COUNT ) usage(); break;
+			case 'i': poll = atoi(optarg); break;
+			case 'j': jitter = atoi(optarg); break;
+			case '1': single = 1; break;
+			default: usage();
+		}
+	}
+	if( (optind != argc - 1) || (poll < 1) ) usage();
+
+	if( strcmp(argv[optind], "-") ) {
+		strncpy(text, argv[optind], MAX_TEXT);
+		ntext = strlen(text);
+	} else {
+		ntext = fread(text, 1, MAX_TEXT, stdin);
+	}
+
+	static char exp[MAX_TEXT + 1];
+	static int src[MAX_TEXT];
+	int nexp = expected(exp, src);
+
+	avrsim_eeprom[META_LAYOUT] = layout;
+	p_Init();
+	usbsim_configure(p_EVENT_USB_Device_ConfigurationChanged);
+
+	if( bps ) {
+		USB_Request_Header_t req = {REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE,
+			CDC_REQ_SetLineEncoding, 0, INTERFACE_ID_CDC_CCI, sizeof(CDC_LineEncoding_t)};
+		CDC_LineEncoding_t le = {bps, CDC_LINEENCODING_OneStopBit, CDC_PARITY_None, 8};
+		usbsim_control(&req, (uint8_t*)&le, p_EVENT_USB_Device_ControlRequest);
+	}
+
+	USB_KeyboardReport_Data_t prev;
+	memset(&prev, 0, sizeof(prev));
+	int pos = 0; // bytes sent
+	unsigned long last = 0; // frame of last key
+	int gaps = 0; // NAKed polls after the first key
+	srand(1);
+
+	while( (ntyped < nexp) && (usbsim_frame_no < MAX_FRAMES) ) {
+		usbsim_frame();
+		if( (rand() % 100) >= jitter ) Pipe_Task();
+
+		// with -1, the next byte goes when everything before it has been typed
+		int n = ntext - pos;
+		if( n > CDC_TXRX_EPSIZE ) n = CDC_TXRX_EPSIZE;
+		if( single ) n = (n && ((pos == 0) || (ntyped == nexp) || (src[ntyped] >= pos))) ? 1 : 0;
+		if( n && usbsim_out_send(CDC_RX_EPADDR, (uint8_t*)text + pos, n) ) {
+			while( n-- ) sent[pos++] = usbsim_frame_no;
+		}
+
+		if( usbsim_frame_no % poll ) continue;
+
+		USB_KeyboardReport_Data_t rep;
+		if( usbsim_in_poll(KEYBOARD_IN_EPADDR, (uint8_t*)&rep) == sizeof(rep) ) {
+			int i, j;
+			for( i = 0; i < 6; ++i ) {
+				if( !rep.KeyCode[i] ) continue;
+				for( j = 0; j < 6; ++j ) if( prev.KeyCode[j] == rep.KeyCode[i] ) break;
+				if( j == 6 ) {
+					press(rep.KeyCode[i], rep.Modifier);
+					last = usbsim_frame_no;
+				}
+			}
+			prev = rep;
+		} else
+		if( ntyped ) {
+			++gaps;
+		}
+
+		if( last && (usbsim_frame_no - last > STALL_FRAMES) ) break;
+	}
+
+	typed[ntyped] = 0;
+	if( nexp < 80 ) {
+		print_text("expected: ", exp);
+		print_text("typed:    ", typed);
+	}
+
+	int ok = (ntyped == nexp) && !memcmp(typed, exp, nexp);
+	printf("%d of %d chars typed%s\n", ntyped, nexp, ok ? "" : ", MISMATCH");
+
+	if( ntyped > 1 ) {
+		double secs = (typed_at[ntyped - 1] - typed_at[0]) / 1000.0;
+		printf("sustained %.1f chars/s, %d poll gaps\n", (ntyped - 1) / secs, gaps);
+	}
+	if( ntyped ) {
+		unsigned long mn = (unsigned long)-1, mx = 0;
+		double sum = 0;
+		int i;
+		for( i = 0; i < ntyped; ++i ) {
+			unsigned long d = typed_at[i] - sent[src[i]];
+			if( d < mn ) mn = d;
+			if( d > mx ) mx = d;
+			sum += d;
+		}
+		printf("latency min/avg/max %lu/%.1f/%lu ms\n", mn, sum / ntyped, mx);
+	}
+
+	return ok ? 0 : 1;
+}
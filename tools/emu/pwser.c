@@ -0,0 +1,350 @@
+/**
+password typist
+
+@file		pwser.c
+@brief		Runs setup mode on the host, measures how serial replies get to the reader and checks the feature reports.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build (from the repository root):
+	cc -std=gnu99 -O2 -Wno-int-to-pointer-cast -Itools/emu -I. -DF_CPU=8000000UL -o pwser \
+		tools/emu/pwser.c tools/emu/usbsim.c tools/emu/avrsim.c s_main.c circbuf8.c ser.c prov.c \
+		sha1.c totp.c xtea.c slot.c layout.c
+
+Usage: pwser [-i poll_ms] [-s bytes [-x]] [command]
+       pwser -f
+
+The CDC transport of s_main.c and the command parser of ser.c run against the
+endpoint model in usbsim.c, one 1 ms frame at a time. All slots are filled
+with passwords of full length, the host opens the port with DTR, sends the
+command (L? by default) and takes an IN packet every poll_ms frames (1). The
+firmware waits for the host in Serial_SendByte, polling sched_now; here each
+poll takes a timer0 count, and the host gets its frame when one is over.
+
+The reply's goodput is taken from the frame the command was accepted to the
+frame its last byte came. -s stops reading after that many bytes, as a host
+that went away would, and -x closes the port there too. The longest the
+parser was held up by a reply is printed either way. Then the port is closed
+and opened again and C? is sent, whose reply has to come alone, without
+anything left of the first one. Last r! is sent with the dip switches on the
+erase address, where it has to answer err, and on slot 3, where it answers rst
+(the restart itself isn't run).
+
+Exit status is 0 when the reply came whole, or with -s the parser was held up
+no longer than ser's deadline, the second reply was clean and r! answered as
+it should. A reader too
+slow to take the reply within the 100 ms it may wait gets part of it.
+
+-f runs the provisioning HID interface (prov.c) instead. Every feature report
+is read and compared with the slots, then one is written and read back at
+once, which has to answer busy without slots, another written meanwhile has
+to be dropped, and after Prov_Task has run the first has to read back as
+written and the second as it was. Then a bit of slot 6 is flipped in the
+eeprom, and report 5 has to flag it. Last report 5 is read from within the
+eeprom writes of p5= and of c!, as the USB interrupt can cut into them, and
+has to answer busy without slots, and not busy once they're done. Exit
+status is 0 when all of it holds.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "avrsim.h"
+#include "usbsim.h"
+#include "s_descriptors.h"
+#include "slot.h"
+#include "prov.h"
+#include "ser.h"
+#include "sched.h"
+#include "main.h"
+
+#define MAX_REPLY 8192
+#define IDLE_FRAMES 200 // a reply is over when nothing came for this long
+#define TX_WAIT_MS 100 // the most a reply may wait for the host, TX_WAIT in s_main.c
+#define SER_DEADLINE 130 // ms, ser's deadline in s_main.c
+
+void s_Init(void);
+void CDC_Task(void);
+void Ser_Task(void);
+
+static uint8_t sw = SW_SETUP_CMD; // dip switches now
+
+uint8_t readswi(void)
+{
+	return sw;
+}
+
+void EVENT_USB_Device_StartOfFrame(void)
+{
+}
+
+void EVENT_USB_Device_Suspend(void)
+{
+}
+
+void EVENT_USB_Device_WakeUp(void)
+{
+}
+
+static int poll = 1;
+static long stop = -1; // stop reading after this many bytes, -1 never
+static int close_at_stop = 0;
+
+static char rx[MAX_REPLY + 1];
+static int nrx = 0;
+static int reading = 0;
+static unsigned long last_rx = 0; // frame of the last IN packet
+
+static void line_state(const uint16_t s)
+{
+	USB_Request_Header_t req = {REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE,
+		CDC_REQ_SetControlLineState, s, INTERFACE_ID_CDC_CCI, 0};
+	usbsim_control(&req, NULL, s_EVENT_USB_Device_ControlRequest);
+}
+
+// one frame of the host, takes an IN packet every poll frames while reading
+static void host_frame(void)
+{
+	usbsim_frame();
+	if( !reading || (usbsim_frame_no % poll) ) return;
+
+	uint8_t b[64];
+	int n = usbsim_in_poll(CDC_TX_EPADDR, b);
+	if( n <= 0 ) return;
+
+	if( nrx + n > MAX_REPLY ) n = MAX_REPLY - nrx;
+	memcpy(rx + nrx, b, n);
+	nrx += n;
+	last_rx = usbsim_frame_no;
+
+	if( (stop >= 0) && (nrx >= stop) ) {
+		reading = 0;
+		if( close_at_stop ) line_state(0);
+	}
+}
+
+static uint32_t now = 0; // timer0 counts
+
+// the firmware's waits poll this, so the host gets its frames meanwhile
+static uint16_t frame_now(void)
+{
+	if( ++now >= (usbsim_frame_no + 1) * SCHED_SOF_PERIOD ) host_frame();
+	return now;
+}
+
+static unsigned long held = 0; // longest Ser_Task run, in frames
+
+// runs frames until the reply is over, returns the frame the command was accepted
+static unsigned long command(const char* cmd)
+{
+	unsigned long sent = 0, done = 0;
+	int pos = 0, len = strlen(cmd);
+
+	while( 1 ) {
+		host_frame();
+		now = usbsim_frame_no * SCHED_SOF_PERIOD;
+		CDC_Task();
+
+		unsigned long f = usbsim_frame_no;
+		Ser_Task();
+		if( usbsim_frame_no - f > held ) held = usbsim_frame_no - f;
+		if( usbsim_frame_no != f ) done = usbsim_frame_no;
+
+		int n = len - pos;
+		if( n > CDC_TXRX_EPSIZE ) n = CDC_TXRX_EPSIZE;
+		if( n && usbsim_out_send(CDC_RX_EPADDR, (uint8_t*)cmd + pos, n) ) {
+			pos += n;
+			if( pos == len ) sent = done = usbsim_frame_no;
+		}
+
+		unsigned long last = (last_rx > done) ? last_rx : done;
+		if( sent && (usbsim_frame_no - last > IDLE_FRAMES) ) return sent;
+	}
+}
+
+#define HID_REPORT_TYPE_FEATURE 3
+
+// GET_REPORT or SET_REPORT of feature report n, returns the bytes received
+static int feature(const uint8_t req, const uint8_t n, uint8_t* r)
+{
+	uint8_t dir = (req == HID_REQ_GetReport) ? REQDIR_DEVICETOHOST : REQDIR_HOSTTODEVICE;
+	USB_Request_Header_t h = {dir | REQTYPE_CLASS | REQREC_INTERFACE, req,
+		(HID_REPORT_TYPE_FEATURE << 8) | n, INTERFACE_ID_Prov, 1 + PROV_REPORT_SIZE};
+	return usbsim_control(&h, r, s_EVENT_USB_Device_ControlRequest);
+}
+
+// report n as read matches the stored slots
+static int report_ok(const uint8_t n, const uint8_t* r)
+{
+	uint8_t i, b[PWD_SIZE];
+	if( (r[0] != n) || r[1] ) return 0;
+	for( i = 0; i < PROV_SLOTS; ++i ) {
+		if( n + i < PWD_COUNT ) slot_read(n + i, b); else memset(b, 0, PWD_SIZE);
+		if( memcmp(r + 2 + i * PWD_SIZE, b, PWD_SIZE) ) return 0;
+	}
+	return 1;
+}
+
+static int cut_at, cuts, cut_busy; // GET_REPORT at eeprom write cut_at, answered busy without slots
+
+static void cut_in(void)
+{
+	if( ++cuts != cut_at ) return;
+
+	uint8_t r[1 + PROV_REPORT_SIZE], i;
+	cut_busy = (feature(HID_REQ_GetReport, 5, r) == sizeof(r)) && (r[1] == PROV_BUSY);
+	for( i = 2; i < sizeof(r); ++i ) cut_busy = cut_busy && !r[i];
+}
+
+// runs a serial command with a GET_REPORT of report 5 cut into its eeprom writes, returns whether it answered busy
+static int cut_command(const char* cmd, const int at)
+{
+	uint8_t r[1 + PROV_REPORT_SIZE];
+
+	cuts = cut_busy = 0;
+	cut_at = at;
+	avrsim_eeprom_writing = cut_in;
+	while( *cmd ) Ser_ProcessByte(*cmd++);
+	avrsim_eeprom_writing = NULL;
+
+	feature(HID_REQ_GetReport, 5, r);
+	return (cuts >= at) && cut_busy && !(r[1] & PROV_BUSY);
+}
+
+static int features(void)
+{
+	uint8_t r[1 + PROV_REPORT_SIZE], w[1 + PROV_REPORT_SIZE], old[1 + PROV_REPORT_SIZE];
+	uint8_t n, i;
+	int ok = 1;
+
+	for( n = 1; n < PWD_COUNT; n += PROV_SLOTS ) {
+		int len = feature(HID_REQ_GetReport, n, r);
+		if( (len != sizeof(r)) || !report_ok(n, r) ) {
+			printf("report %d reads wrong\n", n);
+			ok = 0;
+		}
+	}
+	printf("%d feature reports read%s\n", (PWD_COUNT + PROV_SLOTS - 2) / PROV_SLOTS, ok ? "" : ", MISMATCH");
+
+	feature(HID_REQ_GetReport, 5, old);
+	memset(w, 0, sizeof(w));
+	for( i = 0; i < PROV_SLOTS * PWD_SIZE; ++i ) w[2 + i] = 'A' + i % 26;
+	feature(HID_REQ_SetReport, 3, w);
+
+	int busy = (feature(HID_REQ_GetReport, 3, r) == sizeof(r)) && (r[1] & PROV_BUSY);
+	for( i = 2; i < sizeof(r); ++i ) busy = busy && !r[i];
+	feature(HID_REQ_SetReport, 5, w);
+	Prov_Task();
+
+	feature(HID_REQ_GetReport, 3, r);
+	int stored = !r[1] && !memcmp(r + 2, w + 2, PROV_REPORT_SIZE - 1);
+	feature(HID_REQ_GetReport, 5, r);
+	int dropped = !memcmp(r, old, sizeof(r));
+
+	avrsim_eeprom[PWD_SIZE * 6 + 5] ^= 0x10;
+	feature(HID_REQ_GetReport, 5, r);
+	int flagged = (r[1] == PROV_BAD(1));
+
+	int in_write = cut_command("p5=abcdefgh\r", 10);
+	int in_erase = cut_command("c!\r", 100);
+
+	printf("read while storing: %s\n", busy ? "busy, no slots" : "WRONG");
+	printf("written report: %s\n", stored ? "stored" : "NOT STORED");
+	printf("report written while storing: %s\n", dropped ? "dropped" : "NOT DROPPED");
+	printf("corrupt slot 6: %s\n", flagged ? "flagged" : "NOT FLAGGED");
+	printf("read within p5=: %s\n", in_write ? "busy, no slots" : "WRONG");
+	printf("read within c!: %s\n", in_erase ? "busy, no slots" : "WRONG");
+
+	return ok && busy && stored && dropped && flagged && in_write && in_erase;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pwser [-i poll_ms] [-s bytes [-x]] [command]\n"
+		"       pwser -f\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int feat = 0;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "i:s:xf")) != -1 ) {
+		switch( opt ) {
+			case 'i': poll = atoi(optarg); break;
+			case 's': stop = atol(optarg); break;
+			case 'x': close_at_stop = 1; break;
+			case 'f': feat = 1; break;
+			default: usage();
+		}
+	}
+	if( (optind < argc - 1) || (poll < 1) || (close_at_stop && (stop < 0)) ) usage();
+	if( feat && ((argc != 2) || (optind != argc)) ) usage();
+
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "%s\r", (optind < argc) ? argv[optind] : "L?");
+
+	avrsim_eeprom_write_us = 0;
+	uint8_t n, i, b[PWD_SIZE];
+	for( n = 1; n < PWD_COUNT; ++n ) {
+		for( i = 0; i < PWD_SIZE; ++i ) b[i] = 'a' + (n + i) % 26;
+		slot_write(n, b);
+	}
+
+	avrsim_now = frame_now;
+	s_Init();
+	usbsim_configure(s_EVENT_USB_Device_ConfigurationChanged);
+	if( feat ) return features() ? 0 : 1;
+	line_state(CDC_CONTROL_LINE_OUT_DTR);
+
+	reading = 1;
+	unsigned long t0 = command(cmd);
+	rx[nrx] = 0;
+
+	int ok;
+	if( stop < 0 ) {
+		double secs = (last_rx - t0) / 1000.0;
+		ok = (nrx > 0) && (rx[nrx - 1] == '\n') && (held < TX_WAIT_MS);
+		printf("%d byte reply in %lu ms, %.0f bytes/s\n", nrx, last_rx - t0, (last_rx > t0) ? nrx / secs : 0);
+	} else {
+		ok = (held <= SER_DEADLINE);
+		printf("stopped reading after %d bytes%s\n", nrx, close_at_stop ? " and closed the port" : "");
+	}
+	printf("parser held up %lu ms at most\n", held);
+
+	// a new session has to get only its own reply
+	if( !close_at_stop || reading ) line_state(0);
+	for( i = 0; i < 10; ++i ) {
+		host_frame();
+		CDC_Task();
+	}
+	line_state(CDC_CONTROL_LINE_OUT_DTR);
+	nrx = 0;
+	reading = 1;
+	stop = -1;
+	command("C?\r");
+	rx[nrx] = 0;
+
+	int clean = !strcmp(rx, "s\r\n");
+	printf("next session's reply %s\n", clean ? "clean" : "has stale bytes");
+
+	// r! never restarts into the panic erase
+	sw = SW_ERASE_CMD;
+	nrx = 0;
+	command("r!\r");
+	rx[nrx] = 0;
+	int refused = !strcmp(rx, "err\r\n");
+	sw = 3;
+	nrx = 0;
+	command("r!\r");
+	rx[nrx] = 0;
+	int accepted = !strcmp(rx, "rst\r\n");
+	printf("r! on the erase address %s, on slot 3 %s\n", refused ? "refused" : "ACCEPTED", accepted ? "accepted" : "REFUSED");
+
+	return (ok && clean && refused && accepted) ? 0 : 1;
+}
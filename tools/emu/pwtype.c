@@ -0,0 +1,587 @@
+/**
+password typist
+
+@file		pwtype.c
+@brief		Runs the keyboard personality on the host and types through a uinput keyboard.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build (from the repository root):
+	cc -std=gnu99 -O2 -Wno-int-to-pointer-cast -Itools/emu -I. -o pwtype \
+		tools/emu/pwtype.c tools/emu/usbsim.c tools/emu/avrsim.c k_main.c sha1.c totp.c \
+		xtea.c slot.c layout.c
+
+Usage: pwtype [-n] [-i poll_ms] [-j percent] [-s slot] [-l layout] [-x] [-r|-w slot|-b] [-c|-C] password
+
+The password is encrypted into the slot of an in-memory eeprom and k_main.c types
+it out through the endpoint model in usbsim.c, one 1 ms frame at a time. The
+host polls the keyboard endpoint every poll_ms frames (5, as in the endpoint
+descriptor, by default). Every report the host takes is replayed on a uinput
+virtual keyboard at its frame time. The key events are read back through
+evdev, decoded with the firmware's own c2ksc() table and compared with the
+password. The inter-key timing is printed, and the polls the device NAKed
+between the first and the last key. -j makes the device task miss the given
+percentage of frames, as when another task runs long. -n skips uinput and decodes the
+reports directly, with simulated frame times. With -x the slot is given as hex
+bytecode, like m#= takes it, and the expected text is what its key ops type,
+test patterns up to the 1023 chars kept.
+TOTP codes are computed for the host's current time.
+Tab and enter are shown as \t and \r. -l sets the device layout (si, us, de
+or fr); dead keys are decoded with the space that follows them.
+With -r the host picks the slot again over the LED report channel once typing
+has stopped, one LED report every LED_GAP frames, and expects it typed twice.
+The time from the last LED report to the first retyped key is printed.
+-c turns the host's caps lock on before typing starts; the host toggles it on
+caps lock presses, sends the LED report and applies it to decoded letters.
+-C does the same with the device set to tap caps lock off (k_main.c
+CAPS_TAP), and caps lock has to be on again at the end.
+-w suspends the bus once typing has stopped and turns the dip switches to the
+given slot, which holds the password too. The device should signal remote
+wakeup once the switches settle; the host resumes it after RESUME_FRAMES, as
+USB resume signalling and recovery take, and expects the password typed again.
+The sleep mode, the time to the wakeup signal and from the resume to the first
+key are printed. The clock is set only for slots with TOTP codes.
+-b flips a bit of the stored slot after writing it, and expects the slot's
+CRC check to fail: nothing typed and the LED on.
+
+Exit status is 0 when the decoded text matches the password.
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+
+#include "avrsim.h"
+#include "usbsim.h"
+#include "k_descriptors.h"
+#include "rtc.h"
+#include "slot.h"
+#include "layout.h"
+#include "totp.h"
+#include "sched.h"
+#include "main.h"
+
+#define MAX_FRAMES 60000
+#define IDLE_FRAMES 1000 // stop this long after the last key
+#define LED_GAP 10 // frames between LED reports of a selection frame
+#define SWITCH_AFTER 200 // frames from suspend to the dip switch change with -w
+#define WDT_FRAMES 16 // watchdog tick while suspended
+#define RESUME_FRAMES 30 // host resume signalling (20 ms) and recovery (10 ms)
+
+void LoadSlot(const uint8_t n);
+void HID_Task(void);
+void TOTP_Task(void);
+void Check_Task(void);
+void Wake_Task(void);
+uint8_t c2ksc(const char c, uint8_t* ksc, uint8_t* mod);
+
+static uint8_t slot = 1;
+static uint8_t sw = 1; // dip switches now
+
+uint8_t getswi(void)
+{
+	return slot;
+}
+
+uint8_t readswi(void)
+{
+	return sw;
+}
+
+void EVENT_USB_Device_StartOfFrame(void)
+{
+	k_EVENT_USB_Device_StartOfFrame();
+}
+
+void EVENT_USB_Device_Suspend(void)
+{
+	sched_suspend(1);
+}
+
+void EVENT_USB_Device_WakeUp(void)
+{
+	sched_suspend(0);
+}
+
+// HID keyboard usage to linux key code, as in the kernel's hid-input.c
+static const uint8_t usage2key[0x66] = {
+	0, 0, 0, 0, 30, 48, 46, 32, 18, 33, 34, 35, 23, 36, 37, 38,
+	50, 49, 24, 25, 16, 19, 31, 20, 22, 47, 17, 45, 21, 44, 2, 3,
+	4, 5, 6, 7, 8, 9, 10, 11, 28, 1, 14, 15, 57, 12, 13, 26,
+	27, 43, 43, 39, 40, 41, 51, 52, 53, 58, 59, 60, 61, 62, 63, 64,
+	65, 66, 67, 68, 87, 88, 99, 70, 119, 110, 102, 104, 111, 107, 109, 106,
+	105, 108, 103, 69, 98, 55, 74, 78, 96, 79, 80, 81, 75, 76, 77, 71,
+	72, 73, 82, 83, 86, 127,
+};
+
+// modifier bits 0..7 to linux key code
+static const uint8_t mod2key[8] = {29, 42, 56, 125, 97, 54, 100, 126};
+
+// typed characters
+static char text[1024];
+static double when[1024]; // ms
+static int ntext = 0;
+static uint8_t hostleds = 0; // host's lock key state
+
+static char decode(const uint8_t usage, const uint8_t mod)
+{
+	if( !mod && (usage == HID_KEYBOARD_SC_TAB) ) return '\t';
+	if( !mod && (usage == HID_KEYBOARD_SC_ENTER) ) return '\r';
+
+	int i;
+	for( i = 32; i < 127; ++i ) {
+		uint8_t k, m;
+		if( c2ksc(i, &k, &m) && (k == usage) && (m == mod) ) return i;
+	}
+
+	return '?';
+}
+
+static void decode_press(const uint8_t usage, const uint8_t mod, const double t)
+{
+	static int dead = 0;
+	if( usage == HID_KEYBOARD_SC_CAPS_LOCK ) {
+		hostleds ^= HID_KEYBOARD_LED_CAPSLOCK;
+		return;
+	}
+
+	char c = decode(usage, mod);
+	if( (hostleds & HID_KEYBOARD_LED_CAPSLOCK) && (((c | 0x20) >= 'a') && ((c | 0x20) <= 'z')) ) c ^= 0x20;
+
+	uint8_t k, m;
+	if( dead && (c == ' ') ) { dead = 0; return; } // completes the dead key
+	dead = (c2ksc(c, &k, &m) == 2);
+
+	if( ntext < (int)sizeof(text) - 1 ) {
+		text[ntext] = c;
+		when[ntext] = t;
+		++ntext;
+	}
+}
+
+// uinput
+
+static int ui = -1;
+static int ev = -1;
+static uint8_t evmod = 0;
+
+static void emit(const int type, const int code, const int value)
+{
+	struct input_event e;
+	memset(&e, 0, sizeof(e));
+	e.type = type;
+	e.code = code;
+	e.value = value;
+	if( write(ui, &e, sizeof(e)) < 0 ) perror("uinput");
+}
+
+static int open_event_node(void)
+{
+	char name[64], path[256];
+	if( ioctl(ui, UI_GET_SYSNAME(sizeof(name)), name) < 0 ) return -1;
+	snprintf(path, sizeof(path), "/sys/devices/virtual/input/%s", name);
+
+	int tries;
+	for( tries = 0; tries < 100; ++tries ) {
+		DIR* d = opendir(path);
+		struct dirent* de;
+		while( d && (de = readdir(d)) ) {
+			if( strncmp(de->d_name, "event", 5) ) continue;
+			char dev[300];
+			snprintf(dev, sizeof(dev), "/dev/input/%s", de->d_name);
+			int fd = open(dev, O_RDONLY | O_NONBLOCK);
+			if( fd >= 0 ) { closedir(d); return fd; }
+		}
+		if( d ) closedir(d);
+		usleep(10000);
+	}
+
+	return -1;
+}
+
+static int uinput_open(void)
+{
+	ui = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if( ui < 0 ) return 0;
+
+	ioctl(ui, UI_SET_EVBIT, EV_KEY);
+	int i;
+	for( i = 1; i < 128; ++i ) ioctl(ui, UI_SET_KEYBIT, i);
+
+	struct uinput_setup us;
+	memset(&us, 0, sizeof(us));
+	us.id.bustype = BUS_USB;
+	us.id.vendor = 0x03eb;
+	us.id.product = 0x2042;
+	strcpy(us.name, "pwtype virtual keyboard");
+	if( ioctl(ui, UI_DEV_SETUP, &us) || ioctl(ui, UI_DEV_CREATE) ) return 0;
+
+	ev = open_event_node();
+	if( ev < 0 ) return 0;
+
+	int clk = CLOCK_MONOTONIC; // same clock as the frame times
+	ioctl(ev, EVIOCSCLOCKID, &clk);
+	ioctl(ev, EVIOCGRAB, 1); // keep the keys away from the desktop
+	return 1;
+}
+
+static void uinput_close(void)
+{
+	if( ev >= 0 ) close(ev);
+	if( ui >= 0 ) {
+		ioctl(ui, UI_DEV_DESTROY);
+		close(ui);
+	}
+}
+
+// read back what the input layer made of the reports
+static void evdev_drain(void)
+{
+	struct input_event e;
+	while( read(ev, &e, sizeof(e)) == sizeof(e) ) {
+		if( e.type != EV_KEY ) continue;
+
+		int i;
+		for( i = 0; i < 8; ++i ) {
+			if( e.code == mod2key[i] ) {
+				if( e.value ) evmod |= (1 << i); else evmod &= ~(1 << i);
+				break;
+			}
+		}
+		if( (i < 8) || (e.value != 1) ) continue;
+
+		for( i = 4; i < (int)sizeof(usage2key); ++i ) {
+			if( usage2key[i] == e.code ) {
+				decode_press(i, evmod, e.input_event_sec * 1000.0 + e.input_event_usec / 1000.0);
+				break;
+			}
+		}
+	}
+}
+
+// host side of a report
+
+static void deliver(const USB_KeyboardReport_Data_t* rep, const USB_KeyboardReport_Data_t* prev, const double t)
+{
+	int i, j;
+
+	if( ui < 0 ) {
+		for( i = 0; i < 6; ++i ) {
+			if( !rep->KeyCode[i] ) continue;
+			for( j = 0; j < 6; ++j ) if( prev->KeyCode[j] == rep->KeyCode[i] ) break;
+			if( j == 6 ) decode_press(rep->KeyCode[i], rep->Modifier, t);
+		}
+		return;
+	}
+
+	for( i = 0; i < 6; ++i ) { // released keys
+		if( !prev->KeyCode[i] ) continue;
+		for( j = 0; j < 6; ++j ) if( rep->KeyCode[j] == prev->KeyCode[i] ) break;
+		if( (j == 6) && (prev->KeyCode[i] < sizeof(usage2key)) ) emit(EV_KEY, usage2key[prev->KeyCode[i]], 0);
+	}
+	for( i = 0; i < 8; ++i ) { // modifiers
+		uint8_t b = 1 << i;
+		if( (rep->Modifier ^ prev->Modifier) & b ) emit(EV_KEY, mod2key[i], (rep->Modifier & b) ? 1 : 0);
+	}
+	for( i = 0; i < 6; ++i ) { // pressed keys
+		if( !rep->KeyCode[i] ) continue;
+		for( j = 0; j < 6; ++j ) if( prev->KeyCode[j] == rep->KeyCode[i] ) break;
+		if( (j == 6) && (rep->KeyCode[i] < sizeof(usage2key)) ) emit(EV_KEY, usage2key[rep->KeyCode[i]], 1);
+	}
+	emit(EV_SYN, SYN_REPORT, 0);
+
+	evdev_drain();
+}
+
+// LED reports that pick slot n over the LED channel, see main.h
+static int led_frame(const uint8_t n, uint8_t* leds)
+{
+	uint8_t hi = n >> 2, lo = n & 3;
+	uint8_t sym[6] = {3, 0, 3, hi, lo, ~(hi ^ lo) & 3};
+	int i;
+	for( i = 0; i < 6; ++i ) { // scroll lock toggles on every symbol
+		leds[i] = sym[i] | ((i & 1) ? 0 : HID_KEYBOARD_LED_SCROLLLOCK);
+	}
+	leds[i++] = 0; // host's LEDs again, filled in when sent
+	return i;
+}
+
+// char n of the test pattern, see TEST_CHARS in main.h
+static char test_char(int n)
+{
+	int w = sizeof(TEST_CHARS) - 1, j = n % w, b = n / w;
+	if( j < TEST_MARK ) {
+		while( j-- ) b /= w;
+		j = b % w;
+	}
+	return TEST_CHARS[j];
+}
+
+// text the slot bytecode should type
+static int expected(const uint8_t* b, char* exp)
+{
+	int pc = 0, n = 0;
+	while( pc < PWD_SIZE ) {
+		uint8_t op = b[pc++];
+		uint8_t k, m;
+		if( op == OP_END ) break;
+		if( op & OP_DELAY ) continue;
+		if( op == OP_TAB ) exp[n++] = '\t'; else
+		if( op == OP_ENTER ) exp[n++] = '\r'; else
+		if( op == OP_KEY ) { exp[n++] = decode(b[pc], 0); ++pc; } else
+		if( op == OP_LAYOUT ) { ++pc; } else
+		if( op == OP_CHORD ) { exp[n++] = decode(b[pc + 1], b[pc]); pc += 2; } else
+		if( op == OP_TEST ) {
+			int i, count = b[pc] | (b[pc + 1] << 8);
+			for( i = 0; (i < count) && (n < (int)sizeof(text) - 1); ++i ) exp[n++] = test_char(i);
+			pc += 3;
+		} else
+		if( op == OP_TOTP ) {
+			uint32_t t;
+			rtc_get(&t);
+			totp_code(exp + n, b + pc + 1, b[pc], t);
+			n += TOTP_DIGITS;
+			pc += 1 + b[pc];
+		} else
+		if( c2ksc(op, &k, &m) ) exp[n++] = op;
+	}
+	exp[n] = 0;
+	return n;
+}
+
+static void print_text(const char* label, const char* s)
+{
+	printf("%s", label);
+	for( ; *s; ++s ) {
+		if( *s == '\t' ) printf("\\t"); else
+		if( *s == '\r' ) printf("\\r"); else
+		putchar(*s);
+	}
+	printf("\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: pwtype [-n] [-i poll_ms] [-j percent] [-s slot] [-l layout] [-x] [-r|-w slot|-b] [-c|-C] password\n");
+	exit(2);
+}
+
+int main(int argc, char** argv)
+{
+	int nouinput = 0;
+	int poll = 5;
+	int hex = 0;
+	int retype = 0;
+	int jitter = 0;
+	int wake = 0; // slot to wake the host with
+	int caps = -1;
+	int corrupt = 0;
+	uint8_t layout = 0;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "ni:j:s:l:xrw:bcC")) != -1 ) {
+		switch( opt ) {
+			case 'n': nouinput = 1; break;
+			case 'i': poll = atoi(optarg); break;
+			case 'j': jitter = atoi(optarg); break;
+			case 's': slot = atoi(optarg); break;
+			case 'l': if( (layout = layout_find(optarg)) >= LAYOUT_COUNT ) usage(); break;
+			case 'x': hex = 1; break;
+			case 'r': retype = 1; break;
+			case 'w': wake = atoi(optarg); break;
+			case 'c': caps = CAPS_SHIFT; break;
+			case 'C': caps = CAPS_TAP; break;
+			case 'b': corrupt = 1; break;
+			default: usage();
+		}
+	}
+	if( (optind != argc - 1) || (poll < 1) || (slot < 1) || (slot >= PWD_COUNT) ) usage();
+	if( wake && (retype || (wake == slot) || (wake >= SW_PIPE_CMD)) ) usage();
+	if( corrupt && (retype || wake) ) usage();
+	sw = slot;
+
+	const char* pwd = argv[optind];
+	uint8_t b[PWD_SIZE] = {0};
+	size_t i;
+	if( hex ) {
+		for( i = 0; (i < PWD_SIZE) && pwd[2 * i] && pwd[2 * i + 1]; ++i ) {
+			unsigned v;
+			if( sscanf(pwd + 2 * i, "%2x", &v) != 1 ) usage();
+			b[i] = v;
+		}
+	} else {
+		for( i = 0; (i < PWD_SIZE) && pwd[i]; ++i ) b[i] = pwd[i];
+	}
+	avrsim_eeprom_write_us = 0;
+	avrsim_eeprom[META_LAYOUT] = layout;
+	avrsim_eeprom[META_CAPS] = (caps < 0) ? CAPS_SHIFT : caps;
+	if( caps >= 0 ) hostleds = HID_KEYBOARD_LED_CAPSLOCK;
+	uint8_t leds0 = hostleds, sentleds = 0;
+	slot_write(slot, b);
+	if( wake ) slot_write(wake, b);
+	if( corrupt ) avrsim_eeprom[PWD_SIZE * slot] ^= 0x10;
+	LoadSlot(slot);
+
+	if( memchr(b, OP_TOTP, sizeof(b)) ) rtc_set(time(NULL)); // as the device's clock is set only for TOTP
+	static char exp[2 * sizeof(text)];
+	int len = expected(b, exp);
+	if( retype || wake ) {
+		memcpy(exp + len, exp, len + 1);
+		len *= 2;
+	}
+	if( corrupt ) exp[len = 0] = 0;
+
+	uint8_t leds[8];
+	int nleds = retype ? led_frame(slot, leds) : 0;
+	int led = 0; // LED reports sent
+	int reftext = 0; // index of the first retyped char
+	double tled = 0; // time of the last LED report
+	unsigned long tsusp = 0, tresume = 0; // frames of suspend and resume with -w
+	int powerdown = 0, wdt = 0;
+	USB_Device_RemoteWakeupEnabled = true; // SET_FEATURE, as hosts do for keyboards
+
+	if( !nouinput && !uinput_open() ) {
+		fprintf(stderr, "can't create uinput keyboard (%s), use -n\n", strerror(errno));
+		uinput_close();
+		return 2;
+	}
+
+	usbsim_configure(k_EVENT_USB_Device_ConfigurationChanged);
+
+	struct timespec t0, next;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	next = t0;
+
+	USB_KeyboardReport_Data_t prev;
+	memset(&prev, 0, sizeof(prev));
+	unsigned long last = 0; // frame of last key change
+	unsigned long gap[1024]; // frames of NAKed polls after the first key
+	int ngap = 0;
+	srand(1);
+
+	while( usbsim_frame_no < MAX_FRAMES ) {
+		if( ui >= 0 ) { // real time pacing
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+			next.tv_nsec += 1000000L;
+			if( next.tv_nsec >= 1000000000L ) { next.tv_nsec -= 1000000000L; ++next.tv_sec; }
+		}
+
+		usbsim_frame();
+
+		if( tsusp && !tresume ) { // bus suspended, the device runs on watchdog ticks
+			unsigned long t = usbsim_frame_no - tsusp;
+			if( t == SWITCH_AFTER ) sw = wake;
+			if( !(t % WDT_FRAMES) ) {
+				++wdt;
+				Check_Task();
+				TOTP_Task();
+				HID_Task();
+				Wake_Task();
+			}
+			if( usbsim_wakeup_frame && (usbsim_frame_no - usbsim_wakeup_frame == RESUME_FRAMES) ) {
+				usbsim_resume();
+				tresume = last = usbsim_frame_no; // idle timeout from here
+				reftext = ntext;
+			}
+			continue;
+		}
+		if( wake && !tsusp && last && (usbsim_frame_no - last > IDLE_FRAMES / 2) ) {
+			usbsim_suspend();
+			tsusp = usbsim_frame_no;
+			powerdown = avrsim_powerdown;
+			continue;
+		}
+
+		Check_Task();
+		TOTP_Task();
+		if( (rand() % 100) >= jitter ) HID_Task();
+		Wake_Task();
+
+		if( ((led == 0) || (led == nleds)) && (hostleds != sentleds) ) { // LED report on change, as hosts do
+			if( usbsim_out_send(KEYBOARD_OUT_EPADDR, &hostleds, 1) ) sentleds = hostleds;
+		} else
+		if( (led < nleds) && last && (usbsim_frame_no - last > IDLE_FRAMES / 2) && !(usbsim_frame_no % LED_GAP) ) {
+			if( led == nleds - 1 ) leds[led] = hostleds;
+			if( usbsim_out_send(KEYBOARD_OUT_EPADDR, &leds[led], 1) && (++led == nleds) ) {
+				if( ui >= 0 ) evdev_drain();
+				reftext = ntext;
+				struct timespec t;
+				clock_gettime(CLOCK_MONOTONIC, &t);
+				tled = (ui >= 0) ? t.tv_sec * 1000.0 + t.tv_nsec / 1e6 : usbsim_frame_no;
+			}
+		}
+
+		if( usbsim_frame_no % poll ) continue;
+
+		USB_KeyboardReport_Data_t rep;
+		if( usbsim_in_poll(KEYBOARD_IN_EPADDR, (uint8_t*)&rep) != sizeof(rep) ) {
+			if( last && (ngap < 1024) ) gap[ngap++] = usbsim_frame_no;
+			if( last && (usbsim_frame_no - last > IDLE_FRAMES) ) break;
+			continue;
+		}
+
+		if( memcmp(&rep, &prev, sizeof(rep)) ) last = usbsim_frame_no;
+		deliver(&rep, &prev, usbsim_frame_no);
+		prev = rep;
+	}
+
+	if( ui >= 0 ) {
+		usleep(20000);
+		evdev_drain();
+	}
+	uinput_close();
+
+	text[ntext] = 0;
+	print_text("expected: ", exp);
+	print_text("typed:    ", text);
+
+	if( ntext ) {
+		double mn = 1e9, mx = 0, sum = 0;
+		int i, n = 0;
+		for( i = 1; i < ntext; ++i ) {
+			if( reftext && (i == reftext) ) continue; // the gap before the retype
+			double d = when[i] - when[i - 1];
+			if( d < mn ) mn = d;
+			if( d > mx ) mx = d;
+			sum += d;
+			++n;
+		}
+		double first = (ui >= 0) ? when[0] - (t0.tv_sec * 1000.0 + t0.tv_nsec / 1e6) : when[0];
+		printf("first key after %.1f ms\n", first);
+		if( n ) {
+			printf("inter-key min/avg/max %.1f/%.1f/%.1f ms, %.1f chars/s\n",
+				mn, sum / n, mx, 1000.0 * n / sum);
+		}
+		int gaps = 0;
+		for( i = 0; i < ngap; ++i ) gaps += (gap[i] < last) && !(reftext && (gap[i] > when[reftext - 1]) && (gap[i] < when[reftext]));
+		printf("%d poll gaps\n", gaps);
+		if( retype && reftext && (reftext < ntext) ) {
+			printf("LED channel: retyped %.1f ms after the last LED report\n", when[reftext] - tled);
+		}
+		if( tsusp ) {
+			printf("suspended in %s, %d watchdog ticks", powerdown ? "power down" : "idle", wdt);
+			if( usbsim_wakeup_frame ) printf(", remote wakeup %lu ms after the switch change", usbsim_wakeup_frame - tsusp - SWITCH_AFTER);
+			printf("\n");
+			if( tresume && (reftext < ntext) ) {
+				double t = (ui >= 0) ? when[reftext] - (t0.tv_sec * 1000.0 + t0.tv_nsec / 1e6) : when[reftext];
+				printf("resumed, first key %.1f ms later\n", t - tresume);
+			}
+		}
+	}
+
+	if( hostleds != leds0 ) printf("caps lock left %s\n", (hostleds & HID_KEYBOARD_LED_CAPSLOCK) ? "on" : "off");
+
+	int led_on = (LED_PORT & _BV(LED_BIT)) != 0;
+	if( corrupt ) printf("slot check LED %s\n", led_on ? "on" : "off");
+
+	return (ntext == len && !memcmp(text, exp, len) && (hostleds == leds0) && (led_on == corrupt)) ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+/**
+password typist
+
+@file		usbsim.c
+@brief		Host model of the LUFA device endpoints, driven frame by frame.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Data endpoints keep up to two banks like the hardware. The device side sees
+them through the LUFA Endpoint_* calls, the host side takes IN packets with
+usbsim_in_poll() and puts OUT packets with usbsim_out_send(). While the host
+has the bus suspended frames still count time, but without SOF events.
+*/
+
+#include "usbsim.h"
+
+struct ep_t
+{
+	uint8_t type;
+	uint8_t size;
+	uint8_t banks;
+	uint8_t head; // oldest committed IN bank
+	uint8_t queued; // committed IN banks
+	uint8_t wr; // bytes written to the IN bank being filled
+	uint8_t bank[2][USBSIM_CTL_MAX]; // data endpoints use the first 64 bytes, control transfers go through whole
+	uint8_t blen[2];
+	uint8_t out[USBSIM_CTL_MAX];
+	uint8_t outlen;
+	uint8_t outpos;
+	bool outfull;
+};
+
+volatile uint8_t USB_DeviceState = DEVICE_STATE_Unattached;
+USB_Request_Header_t USB_ControlRequest;
+bool USB_Device_RemoteWakeupEnabled = false;
+
+unsigned long usbsim_frame_no = 0;
+unsigned long usbsim_wakeup_frame = 0; // frame of the device's last remote wakeup signal, 0 if none
+
+static struct ep_t eps[USBSIM_MAX_EP];
+static uint8_t cur = 0;
+static bool sof_events = false;
+static bool setup = false; // a control request is waiting for its handler
+
+void EVENT_USB_Device_StartOfFrame(void);
+void EVENT_USB_Device_Suspend(void);
+void EVENT_USB_Device_WakeUp(void);
+
+void USB_Init(void)
+{
+}
+
+void USB_Disable(void)
+{
+	USB_DeviceState = DEVICE_STATE_Unattached;
+}
+
+void USB_USBTask(void)
+{
+}
+
+void USB_Device_EnableSOFEvents(void)
+{
+	sof_events = true;
+}
+
+void USB_Device_DisableSOFEvents(void)
+{
+	sof_events = false;
+}
+
+void USB_Device_SendRemoteWakeup(void)
+{
+	if( USB_DeviceState == DEVICE_STATE_Suspended ) usbsim_wakeup_frame = usbsim_frame_no;
+}
+
+bool Endpoint_ConfigureEndpoint(const uint8_t Address, const uint8_t Type, const uint16_t Size, const uint8_t Banks)
+{
+	uint8_t n = Address & 0x0f;
+	if( (n >= USBSIM_MAX_EP) || (Size > 64) || (Banks < 1) || (Banks > 2) ) return false;
+
+	struct ep_t* e = &eps[n];
+	memset(e, 0, sizeof(*e));
+	e->type = Type;
+	e->size = Size;
+	e->banks = Banks;
+	return true;
+}
+
+void Endpoint_SelectEndpoint(const uint8_t Address)
+{
+	cur = Address & 0x0f;
+}
+
+uint8_t Endpoint_GetCurrentEndpoint(void)
+{
+	return cur;
+}
+
+bool Endpoint_IsINReady(void)
+{
+	return eps[cur].queued < eps[cur].banks;
+}
+
+bool Endpoint_IsOUTReceived(void)
+{
+	return eps[cur].outfull;
+}
+
+bool Endpoint_IsSETUPReceived(void)
+{
+	return (cur == ENDPOINT_CONTROLEP) && setup;
+}
+
+bool Endpoint_IsReadWriteAllowed(void)
+{
+	struct ep_t* e = &eps[cur];
+	if( e->outfull ) return e->outpos < e->outlen;
+	return (e->queued < e->banks) && (e->wr < e->size);
+}
+
+uint16_t Endpoint_BytesInEndpoint(void)
+{
+	struct ep_t* e = &eps[cur];
+	return e->outfull ? e->outlen - e->outpos : e->wr;
+}
+
+void Endpoint_ClearIN(void)
+{
+	struct ep_t* e = &eps[cur];
+	if( e->queued >= e->banks ) return;
+	e->blen[(e->head + e->queued) % e->banks] = e->wr;
+	e->queued++;
+	e->wr = 0;
+}
+
+void Endpoint_ClearOUT(void)
+{
+	eps[cur].outfull = false;
+}
+
+void Endpoint_ClearSETUP(void)
+{
+	setup = false;
+}
+
+void Endpoint_AbortPendingIN(void)
+{
+	struct ep_t* e = &eps[cur];
+	e->head = e->queued = 0;
+}
+
+void Endpoint_ClearStatusStage(void)
+{
+}
+
+void Endpoint_StallTransaction(void)
+{
+}
+
+uint8_t Endpoint_Read_8(void)
+{
+	struct ep_t* e = &eps[cur];
+	return (e->outpos < e->outlen) ? e->out[e->outpos++] : 0;
+}
+
+void Endpoint_Write_8(const uint8_t Data)
+{
+	struct ep_t* e = &eps[cur];
+	if( e->wr < sizeof(e->bank[0]) ) e->bank[(e->head + e->queued) % e->banks][e->wr++] = Data;
+}
+
+uint8_t Endpoint_Write_Stream_LE(const void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed)
+{
+	const uint8_t* p = Buffer;
+	while( Length-- ) Endpoint_Write_8(*p++);
+	if( BytesProcessed ) *BytesProcessed = 0;
+	return 0;
+}
+
+uint8_t Endpoint_Read_Stream_LE(void* const Buffer, uint16_t Length, uint16_t* const BytesProcessed)
+{
+	uint8_t* p = Buffer;
+	while( Length-- ) *p++ = Endpoint_Read_8();
+	if( BytesProcessed ) *BytesProcessed = 0;
+	return 0;
+}
+
+uint8_t Endpoint_Write_Control_Stream_LE(const void* const Buffer, uint16_t Length)
+{
+	return Endpoint_Write_Stream_LE(Buffer, Length, NULL);
+}
+
+uint8_t Endpoint_Read_Control_Stream_LE(void* const Buffer, uint16_t Length)
+{
+	return Endpoint_Read_Stream_LE(Buffer, Length, NULL);
+}
+
+/**
+@brief Bus reset, the device is in the default state with only the control endpoint.
+*/
+void usbsim_reset(void)
+{
+	memset(eps, 0, sizeof(eps));
+	Endpoint_ConfigureEndpoint(ENDPOINT_CONTROLEP, EP_TYPE_CONTROL, 8, 1);
+	USB_DeviceState = DEVICE_STATE_Default;
+	USB_Device_RemoteWakeupEnabled = false;
+	sof_events = false;
+}
+
+/**
+@brief Brings the device to the configured state.
+@param[in]	config_changed	Device's configuration changed event handler
+*/
+void usbsim_configure(void (*config_changed)(void))
+{
+	memset(eps, 0, sizeof(eps));
+	Endpoint_ConfigureEndpoint(ENDPOINT_CONTROLEP, EP_TYPE_CONTROL, 8, 1);
+	USB_DeviceState = DEVICE_STATE_Configured;
+	config_changed();
+}
+
+/**
+@brief Host control transfer, run through the device's control request handler.
+@param[in]		req		Setup packet
+@param[in,out]	data	Data stage of wLength bytes, sent to the device or received from it
+@param[in]		handler	Device's control request event handler
+@return Bytes received from the device, -1 if the handler left the request to the library,
+which serves the standard requests and stalls the rest.
+*/
+int usbsim_control(const USB_Request_Header_t* req, uint8_t* data, void (*handler)(void))
+{
+	struct ep_t* e = &eps[ENDPOINT_CONTROLEP];
+	uint8_t prev = cur;
+
+	USB_ControlRequest = *req;
+	cur = ENDPOINT_CONTROLEP;
+	e->head = e->queued = e->wr = 0;
+	e->outfull = false;
+	if( !(req->bmRequestType & REQDIR_DEVICETOHOST) && req->wLength ) {
+		e->outlen = (req->wLength < sizeof(e->out)) ? req->wLength : sizeof(e->out);
+		memcpy(e->out, data, e->outlen);
+		e->outpos = 0;
+		e->outfull = true;
+	}
+
+	setup = true;
+	handler();
+
+	int n = 0;
+	if( setup ) {
+		setup = false;
+		n = -1;
+	} else
+	if( req->bmRequestType & REQDIR_DEVICETOHOST ) {
+		n = e->queued ? e->blen[e->head] : e->wr; // the handler may leave the last packet for the library to send
+		if( n > req->wLength ) n = req->wLength;
+		memcpy(data, e->bank[e->head], n);
+	}
+	e->head = e->queued = e->wr = 0;
+	e->outfull = false;
+
+	cur = prev;
+	return n;
+}
+
+/**
+@brief Starts the next 1 ms frame, or lets 1 ms pass while suspended.
+*/
+void usbsim_frame(void)
+{
+	++usbsim_frame_no;
+	if( sof_events && (USB_DeviceState != DEVICE_STATE_Suspended) ) EVENT_USB_Device_StartOfFrame();
+}
+
+/**
+@brief Host suspends the bus, the device gets its suspend event.
+*/
+void usbsim_suspend(void)
+{
+	USB_DeviceState = DEVICE_STATE_Suspended;
+	EVENT_USB_Device_Suspend();
+}
+
+/**
+@brief Host resumes the bus, the device gets its wakeup event.
+*/
+void usbsim_resume(void)
+{
+	USB_DeviceState = DEVICE_STATE_Configured;
+	EVENT_USB_Device_WakeUp();
+}
+
+/**
+@brief Host IN token.
+@param[in]	addr	Endpoint address
+@param[out]	buf		Packet data, up to 64 bytes
+@return Packet length or -1 if the device NAKed.
+*/
+int usbsim_in_poll(const uint8_t addr, uint8_t* buf)
+{
+	struct ep_t* e = &eps[addr & 0x0f];
+	if( !e->queued ) return -1;
+
+	int len = e->blen[e->head];
+	memcpy(buf, e->bank[e->head], len);
+	e->head = (e->head + 1) % e->banks;
+	e->queued--;
+	return len;
+}
+
+/**
+@brief Host OUT token.
+@param[in]	addr	Endpoint address
+@param[in]	buf		Packet data
+@param[in]	len		Packet length, up to the endpoint size
+@return True if accepted, false if the device NAKed.
+*/
+int usbsim_out_send(const uint8_t addr, const uint8_t* buf, const uint8_t len)
+{
+	struct ep_t* e = &eps[addr & 0x0f];
+	if( e->outfull || (len > e->size) ) return 0;
+
+	memcpy(e->out, buf, len);
+	e->outlen = len;
+	e->outpos = 0;
+	e->outfull = true;
+	return 1;
+}
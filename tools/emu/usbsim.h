@@ -0,0 +1,21 @@
+#ifndef USBSIM_H
+#define USBSIM_H
+
+#include <LUFA/Drivers/USB/USB.h>
+
+#define USBSIM_MAX_EP 5 // endpoints 0..4, as on the atmega32u2
+#define USBSIM_CTL_MAX 255 // longest control transfer data stage
+
+extern unsigned long usbsim_frame_no; // frames since start
+extern unsigned long usbsim_wakeup_frame; // frame of the device's last remote wakeup signal, 0 if none
+
+void usbsim_reset(void);
+void usbsim_configure(void (*config_changed)(void));
+void usbsim_frame(void);
+void usbsim_suspend(void);
+void usbsim_resume(void);
+int usbsim_in_poll(const uint8_t addr, uint8_t* buf);
+int usbsim_out_send(const uint8_t addr, const uint8_t* buf, const uint8_t len);
+int usbsim_control(const USB_Request_Header_t* req, uint8_t* data, void (*handler)(void));
+
+#endif
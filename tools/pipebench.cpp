@@ -0,0 +1,224 @@
+/**
+password typist
+
+@file		pipebench.cpp
+@brief		Measures the typing pipe (DIP address 14): sustained rate and per char latency.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build: g++ -std=c++17 -O2 -pthread -o pipebench pipebench.cpp
+
+Usage: pipebench [-n chars] [-b bps] [-1] [-d /dev/input/eventN] /dev/ttyACMx
+
+Writes n (1000 by default) random letters and digits to the pipe's serial port,
+which type in every layout as one key each. The pipe's keys are grabbed from
+its evdev node (found by the name "pwd pipe" without -d), so they go nowhere
+else. Latency is counted per char from the return of the write() that sent it
+to its key press event; with a full pipe it includes the wait behind the chars
+ahead of it. -1 writes one char at a time, after the previous one was typed, for
+the latency of an idle pipe. -b sets the line speed, which limits the typing
+rate to bps / 10 chars per second.
+Reading evdev nodes usually needs root.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int STALL_MS = 2000; // give up when nothing is typed for this long
+
+// Opens the first event node with the pipe's name in it.
+int find_device(std::string& path)
+{
+	DIR* d = opendir("/dev/input");
+	if( !d ) return -1;
+
+	int fd = -1;
+	while( dirent* de = readdir(d) ) {
+		if( std::strncmp(de->d_name, "event", 5) ) continue;
+		std::string p = std::string("/dev/input/") + de->d_name;
+		int f = open(p.c_str(), O_RDONLY | O_NONBLOCK);
+		if( f < 0 ) continue;
+
+		char name[256] = "";
+		ioctl(f, EVIOCGNAME(sizeof(name)), name);
+		unsigned long keys[KEY_MAX / (8 * sizeof(long)) + 1] = {0};
+		ioctl(f, EVIOCGBIT(EV_KEY, sizeof(keys)), keys);
+		if( std::strstr(name, "pwd pipe") && (keys[KEY_A / (8 * sizeof(long))] & (1UL << (KEY_A % (8 * sizeof(long))))) ) {
+			path = p;
+			fd = f;
+			break;
+		}
+		close(f);
+	}
+
+	closedir(d);
+	return fd;
+}
+
+speed_t speed(int bps)
+{
+	switch( bps ) {
+		case 1200: return B1200;
+		case 2400: return B2400;
+		case 4800: return B4800;
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+	}
+	return 0;
+}
+
+bool is_modifier(int code)
+{
+	return code == KEY_LEFTCTRL || code == KEY_LEFTSHIFT || code == KEY_LEFTALT || code == KEY_LEFTMETA
+		|| code == KEY_RIGHTCTRL || code == KEY_RIGHTSHIFT || code == KEY_RIGHTALT || code == KEY_RIGHTMETA;
+}
+
+// Waits for the next non-modifier key press, false when none comes in STALL_MS.
+bool next_press(int ev, Clock::time_point& t)
+{
+	while( true ) {
+		input_event e;
+		while( read(ev, &e, sizeof(e)) == sizeof(e) ) {
+			if( e.type == EV_KEY && e.value == 1 && !is_modifier(e.code) ) {
+				t = Clock::now();
+				return true;
+			}
+		}
+
+		pollfd pfd = {ev, POLLIN, 0};
+		int r = poll(&pfd, 1, STALL_MS);
+		if( r < 0 && errno == EINTR ) continue;
+		if( r <= 0 ) return false;
+	}
+}
+
+bool write_all(int fd, const char* p, size_t n)
+{
+	while( n ) {
+		ssize_t w = write(fd, p, n);
+		if( w < 0 ) {
+			if( errno == EINTR || errno == EAGAIN ) continue;
+			return false;
+		}
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+
+void usage()
+{
+	std::fprintf(stderr, "usage: pipebench [-n chars] [-b bps] [-1] [-d /dev/input/eventN] /dev/ttyACMx\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	int n = 1000;
+	int bps = 115200;
+	bool single = false;
+	std::string evpath;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "n:b:1d:")) != -1 ) {
+		switch( opt ) {
+			case 'n': n = std::max(1, std::atoi(optarg)); break;
+			case 'b': bps = std::atoi(optarg); break;
+			case '1': single = true; break;
+			case 'd': evpath = optarg; break;
+			default: usage(); return 2;
+		}
+	}
+	if( argc - optind != 1 || !speed(bps) ) { usage(); return 2; }
+
+	int ev = evpath.empty() ? find_device(evpath) : open(evpath.c_str(), O_RDONLY | O_NONBLOCK);
+	if( ev < 0 ) {
+		std::fprintf(stderr, "%s: %s\n", evpath.empty() ? "pwd pipe" : evpath.c_str(),
+			evpath.empty() ? "not found" : std::strerror(errno));
+		return 2;
+	}
+	ioctl(ev, EVIOCGRAB, 1);
+
+	int tty = open(argv[optind], O_RDWR | O_NOCTTY);
+	if( tty < 0 ) { std::perror(argv[optind]); return 2; }
+	termios t;
+	if( tcgetattr(tty, &t) == 0 ) {
+		cfmakeraw(&t);
+		cfsetspeed(&t, speed(bps)); // SET_LINE_CODING, which sets the typing rate
+		t.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(tty, TCSANOW, &t);
+	}
+
+	static const char chars[] = "0123456789abcdefghijklmnopqrstuvwxABCDEFGHIJKLMNOPQRSTUVWX"; // no y and z, swapped in some layouts
+	std::mt19937 rng(std::random_device{}());
+	std::string text;
+	for( int i = 0; i < n; ++i ) text += chars[rng() % (sizeof(chars) - 1)];
+
+	std::vector<Clock::time_point> sent(n), typed(n);
+	int ntyped = 0;
+	bool ok = true;
+
+	if( single ) {
+		for( int i = 0; i < n && ok; ++i ) {
+			ok = write_all(tty, &text[i], 1);
+			sent[i] = Clock::now();
+			ok = ok && next_press(ev, typed[i]);
+			ntyped += ok;
+		}
+	} else {
+		std::thread writer([&] {
+			for( int i = 0; i < n; i += 16 ) {
+				int k = std::min(16, n - i);
+				if( !write_all(tty, &text[i], k) ) break;
+				auto now = Clock::now();
+				for( int j = 0; j < k; ++j ) sent[i + j] = now;
+			}
+		});
+		while( ntyped < n && next_press(ev, typed[ntyped]) ) ++ntyped;
+		writer.join();
+	}
+
+	std::printf("%d of %d chars typed\n", ntyped, n);
+	if( ntyped > 1 ) {
+		double secs = std::chrono::duration<double>(typed[ntyped - 1] - typed[0]).count();
+		std::printf("sustained %.1f chars/s\n", (ntyped - 1) / secs);
+	}
+	if( ntyped ) {
+		double mn = 1e9, mx = 0, sum = 0;
+		for( int i = 0; i < ntyped; ++i ) {
+			double d = std::chrono::duration<double, std::milli>(typed[i] - sent[i]).count();
+			mn = std::min(mn, d);
+			mx = std::max(mx, d);
+			sum += d;
+		}
+		std::printf("latency min/avg/max %.1f/%.1f/%.1f ms\n", mn, sum / ntyped, mx);
+	}
+
+	close(tty);
+	close(ev);
+	return (ntyped == n) ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+/**
+password typist
+
+@file		pwcheck.cpp
+@brief		Checks the typing test pattern as a host received it, and the rate it came at.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build: g++ -std=c++17 -O2 -o pwcheck pwcheck.cpp
+
+Usage: pwcheck [-e [-d /dev/input/eventN]] [-n count] [-t timeout_ms]
+
+A slot with the OP_TEST op (see main.h) types a pattern in blocks of 30
+chars: block b starts with b in 3 base 30 digits, and char j of the block is
+TEST_CHARS[j]. pwcheck reads it from stdin, as the host's keyboard input
+delivers it to programs, or with -e straight from the device's evdev node,
+grabbed so the keys go nowhere else. Without -d the first input device whose
+name contains "pwd keyboard" is used; reading evdev nodes usually needs root.
+The chars of the pattern are on the same keys in every layout, so -e needs no
+keymap.
+
+A char that isn't the expected one is placed at the pattern position ahead
+whose chars best match the 33 that follow it, enough to take in the next block
+number, so a gap is measured whole however long it is. A gap of a block or
+more is only taken when that block number came whole. Of equally good
+positions, or when less than half of them match anywhere, the nearest is
+taken. When the chars that follow go on from the expected position at least
+as well, the char is an extra one instead. Two swapped neighbours are counted
+as reordered, a gap as dropped chars, an extra char that turns up within a
+block after the gap it left as reordered and any other extra char as
+duplicated. -n gives the count the slot types, so chars missing at the end
+count as dropped too. Reading stops at enter, or timeout_ms (2000) after
+the last char. The rate is taken from the first to the last char; on stdin
+the times are those of the reads, so a terminal that passes input in bursts
+makes them coarser, and piped input has no rate at all.
+
+Exit status is 0 when the whole pattern came through intact.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+constexpr char TEST_CHARS[] = "0123456789bcdefghijklnoprstuvx"; // as in main.h
+constexpr int N = sizeof(TEST_CHARS) - 1;
+constexpr int MARK = 3; // block number digits, TEST_MARK in main.h
+constexpr long MAX_COUNT = 65535; // the op's count is 16 bits
+constexpr int WINDOW = N + MARK; // chars after a misplaced one compared to place it
+
+// linux key codes of TEST_CHARS
+constexpr uint16_t test_keys[N] = {
+	KEY_0, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9,
+	KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K,
+	KEY_L, KEY_N, KEY_O, KEY_P, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_X,
+};
+
+using Clock = std::chrono::steady_clock;
+
+struct Rx
+{
+	int sym; // index in TEST_CHARS, -1 for anything else
+	double t; // ms
+};
+
+// symbol of pattern position p
+int sym_at(long p)
+{
+	long j = p % N, b = p / N;
+	if( j < MARK ) {
+		while( j-- ) b /= N;
+		j = b % N;
+	}
+	return j;
+}
+
+// How many of the WINDOW chars of rx from i on are those of the pattern from p on.
+int match(const std::vector<Rx>& rx, size_t i, long p)
+{
+	int score = 0;
+	for( int k = 0; k < WINDOW && i + k < rx.size() && p + k < MAX_COUNT; ++k ) {
+		if( rx[i + k].sym == sym_at(p + k) ) ++score;
+	}
+	return score;
+}
+
+// The block number after pattern position p came whole, with the char before it, if rx[i] is p.
+bool marked(const std::vector<Rx>& rx, size_t i, long p)
+{
+	long m = (p / N + 1) * N;
+	size_t k = i + (m - p);
+	if( k + MARK > rx.size() || m + MARK > MAX_COUNT ) return false;
+	for( int d = -1; d < MARK; ++d ) {
+		if( rx[k + d].sym != sym_at(m + d) ) return false;
+	}
+	return true;
+}
+
+// Position at or after from of rx[i], whose following chars match the pattern best. A gap of a
+// block or more is only taken on the next block number. Of equals the nearest is taken, and
+// without the following chars to tell, the nearest.
+long place(const std::vector<Rx>& rx, size_t i, long from, int& score)
+{
+	long best = -1, near = -1;
+	score = -1;
+	for( long p = from; p < MAX_COUNT; ++p ) {
+		if( sym_at(p) != rx[i].sym ) continue;
+		if( near < 0 ) near = p;
+		if( p - from >= N - 1 && !marked(rx, i, p) ) continue;
+		int s = match(rx, i + 1, p + 1);
+		if( s > score ) {
+			best = p;
+			score = s;
+			if( s == WINDOW ) break;
+		}
+	}
+	if( score < WINDOW / 2 ) {
+		score = match(rx, i + 1, near + 1);
+		return near;
+	}
+	return best;
+}
+
+// Opens the first event node with the device's name in it.
+int find_device(std::string& path)
+{
+	DIR* d = opendir("/dev/input");
+	if( !d ) return -1;
+
+	int fd = -1;
+	while( dirent* de = readdir(d) ) {
+		if( std::strncmp(de->d_name, "event", 5) ) continue;
+		std::string p = std::string("/dev/input/") + de->d_name;
+		int f = open(p.c_str(), O_RDONLY | O_NONBLOCK);
+		if( f < 0 ) continue;
+
+		char name[256] = "";
+		ioctl(f, EVIOCGNAME(sizeof(name)), name);
+		if( std::strstr(name, "pwd keyboard") ) {
+			path = p;
+			fd = f;
+			break;
+		}
+		close(f);
+	}
+
+	closedir(d);
+	return fd;
+}
+
+// Waits for input on fd, at most timeout_ms once something came. Returns false on timeout or error.
+bool wait_input(int fd, bool started, int timeout_ms)
+{
+	while( true ) {
+		pollfd pfd = {fd, POLLIN, 0};
+		int r = poll(&pfd, 1, started ? timeout_ms : -1);
+		if( r < 0 && errno == EINTR ) continue;
+		return r > 0;
+	}
+}
+
+double ms(Clock::time_point t0)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// Returns false when stdin isn't a terminal, and the read times say nothing about the rate.
+bool read_stdin(std::vector<Rx>& rx, int timeout_ms)
+{
+	termios old;
+	bool tty = isatty(0) && !tcgetattr(0, &old);
+	if( tty ) { // chars as they come, not lines
+		termios raw = old;
+		raw.c_lflag &= ~(ICANON | ECHO);
+		raw.c_cc[VMIN] = 1;
+		raw.c_cc[VTIME] = 0;
+		tcsetattr(0, TCSANOW, &raw);
+	}
+
+	auto t0 = Clock::now();
+	bool done = false;
+	while( !done && wait_input(0, !rx.empty(), timeout_ms) ) {
+		char buf[256];
+		ssize_t n = read(0, buf, sizeof(buf));
+		if( n <= 0 ) break;
+		double t = ms(t0);
+		for( ssize_t i = 0; i < n; ++i ) {
+			char c = buf[i];
+			if( c == '\n' || c == '\r' ) {
+				if( !rx.empty() ) { done = true; break; }
+				continue;
+			}
+			const char* p = std::strchr(TEST_CHARS, c | 0x20);
+			rx.push_back({(p && *p) ? int(p - TEST_CHARS) : -1, t});
+		}
+	}
+
+	if( tty ) tcsetattr(0, TCSANOW, &old);
+	return tty;
+}
+
+void read_evdev(int fd, std::vector<Rx>& rx, int timeout_ms)
+{
+	int clk = CLOCK_MONOTONIC;
+	ioctl(fd, EVIOCSCLOCKID, &clk);
+	ioctl(fd, EVIOCGRAB, 1);
+
+	bool done = false;
+	while( !done && wait_input(fd, !rx.empty(), timeout_ms) ) {
+		input_event e;
+		while( read(fd, &e, sizeof(e)) == sizeof(e) ) {
+			if( e.type != EV_KEY || e.value != 1 ) continue;
+			if( e.code == KEY_ENTER || e.code == KEY_KPENTER ) {
+				if( !rx.empty() ) { done = true; break; }
+				continue;
+			}
+			if( e.code == KEY_LEFTSHIFT || e.code == KEY_RIGHTSHIFT || e.code == KEY_CAPSLOCK ) continue;
+
+			int sym = -1;
+			for( int i = 0; i < N; ++i ) if( test_keys[i] == e.code ) sym = i;
+			rx.push_back({sym, e.input_event_sec * 1000.0 + e.input_event_usec / 1000.0});
+		}
+	}
+
+	ioctl(fd, EVIOCGRAB, 0);
+}
+
+void usage()
+{
+	std::fprintf(stderr, "usage: pwcheck [-e [-d /dev/input/eventN]] [-n count] [-t timeout_ms]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	bool evdev = false;
+	std::string dev;
+	long count = -1;
+	int timeout_ms = 2000;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "ed:n:t:")) != -1 ) {
+		switch( opt ) {
+			case 'e': evdev = true; break;
+			case 'd': dev = optarg; break;
+			case 'n': count = std::atol(optarg); break;
+			case 't': timeout_ms = std::atoi(optarg); break;
+			default: usage(); return 2;
+		}
+	}
+	if( optind != argc || timeout_ms <= 0 || (!dev.empty() && !evdev) ) {
+		usage();
+		return 2;
+	}
+
+	std::vector<Rx> rx;
+	bool timed = true;
+	if( evdev ) {
+		int fd = dev.empty() ? find_device(dev) : open(dev.c_str(), O_RDONLY | O_NONBLOCK);
+		if( fd < 0 ) {
+			std::fprintf(stderr, "can't open %s: %s\n", dev.empty() ? "a pwd keyboard event node" : dev.c_str(), std::strerror(errno));
+			return 2;
+		}
+		std::fprintf(stderr, "reading %s, type the test slot\n", dev.c_str());
+		read_evdev(fd, rx, timeout_ms);
+		close(fd);
+	} else {
+		std::fprintf(stderr, "reading stdin, type the test slot\n");
+		timed = read_stdin(rx, timeout_ms);
+	}
+
+	long pos = 0; // pattern position expected next
+	long ok = 0, dropped = 0, dup = 0, reord = 0, other = 0;
+	std::vector<long> gaps; // positions counted as dropped, latest last
+	for( size_t i = 0; i < rx.size(); ++i ) {
+		int v = rx[i].sym;
+		if( v < 0 ) { ++other; continue; }
+
+		if( v == sym_at(pos) ) {
+			++ok;
+			++pos;
+			continue;
+		}
+		if( v == sym_at(pos + 1) && i + 1 < rx.size() && rx[i + 1].sym == sym_at(pos) ) { // neighbours swapped
+			reord += 2;
+			pos += 2;
+			++i;
+			continue;
+		}
+
+		// an extra char when the pattern goes on from pos after it, at least as well as after a gap
+		int ahead;
+		long p = place(rx, i, pos + 1, ahead);
+		if( p < 0 || match(rx, i + 1, pos) >= ahead ) {
+			auto g = gaps.rbegin();
+			while( g != gaps.rend() && *g > pos - N && sym_at(*g) != v ) ++g;
+			bool late = g != gaps.rend() && *g > pos - N && (!pos || v != sym_at(pos - 1));
+			if( late ) { // behind, the gap it left was counted as dropped
+				gaps.erase(std::next(g).base());
+				--dropped;
+				++reord;
+			} else {
+				++dup;
+			}
+			continue;
+		}
+
+		for( long q = pos; q < p; ++q ) gaps.push_back(q);
+		dropped += p - pos;
+		++ok;
+		pos = p + 1;
+	}
+	if( count >= 0 && pos < count ) dropped += count - pos;
+
+	std::printf("%zu chars, %ld in place", rx.size(), ok);
+	if( count >= 0 ) std::printf(" of %ld", count);
+	std::printf("\ndropped %ld, duplicated %ld, reordered %ld, other %ld\n", dropped, dup, reord, other);
+	if( count >= 0 && pos > count ) std::printf("%ld chars past the end of the pattern\n", pos - count);
+	if( timed && rx.size() > 1 ) {
+		double secs = (rx.back().t - rx.front().t) / 1000.0;
+		if( secs > 0 ) std::printf("%.1f chars/s over %.3f s\n", (rx.size() - 1) / secs, secs);
+	}
+
+	bool intact = !dropped && !dup && !reord && !other && (count < 0 || pos == count);
+	return intact ? 0 : 1;
+}
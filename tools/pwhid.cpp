@@ -0,0 +1,382 @@
+/**
+password typist
+
+@file		pwhid.cpp
+@brief		Provisions a device in setup mode through its HID interface, with hidraw.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build: g++ -std=c++17 -O2 -o pwhid pwhid.cpp
+
+Usage: pwhid [-d /dev/hidrawN] [-t timeout_ms] vault.txt
+       pwhid [-d /dev/hidrawN] -r
+       pwhid [-d /dev/hidrawN] -b /dev/ttyACMx vault.txt
+
+The vault file is the one pwprov takes, p#=text and m#=hex lines. Unlisted
+slots are stored empty. Feature report n carries slots n and n+1, so the 15
+slots go in 8 SET_REPORTs. Each is followed by a GET_REPORT of the same report,
+which returns the slots as read back from the device's storage. Its status
+byte says when the device is still writing, and the GET_REPORT is repeated
+then; a SET_REPORT isn't sent before the last one was read back. The status
+also flags slots whose stored bytes fail the device's CRC check, which fails
+the store. -r prints the slots the way L? does, with a "# bad" line before a
+flagged one. Without -d, the hidraw node of the setup mode device is looked
+up by its USB ids.
+
+-b benchmarks the HID path against the serial one of the same device: the
+slots are emptied, the vault is stored with m#= commands over the serial port
+and checked with H?, the slots are emptied again and the vault is stored over
+HID and checked by reading back. Both are timed from the first command to the
+last check. Slot writes take the same eeprom time either way; what differs is
+the number of transfers and the host's work around them. Needs read and write
+access to the hidraw node, usually root or a udev rule.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <linux/hidraw.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+constexpr int PWD_SIZE = 32; // as in Config/AppConfig.h
+constexpr int PWD_COUNT = 16; // as in Config/AppConfig.h
+constexpr int REPORT_SLOTS = 2; // slots per feature report, PROV_SLOTS in Config/AppConfig.h
+constexpr int REPORT_SIZE = 2 + REPORT_SLOTS * PWD_SIZE; // with the report id and status byte, 1 + PROV_REPORT_SIZE
+constexpr uint8_t STATUS_BUSY = 0x80; // the device is storing slots, PROV_BUSY in prov.h
+constexpr uint8_t STATUS_BAD = 0x01; // shifted by the slot's place in the report, it fails its CRC, PROV_BAD in prov.h
+constexpr int VENDOR_ID = 0x03eb;
+constexpr int PRODUCT_ID = 0x2044; // setup mode, s_descriptors.c
+
+using Clock = std::chrono::steady_clock;
+using Slots = std::vector<std::string>; // PWD_SIZE bytes each, index is slot number
+
+int ptoi(char c)
+{
+	if( c >= '0' && c <= '9' ) return c - '0';
+	if( c >= 'a' && c <= 'z' ) return c - 'a' + 10;
+	return -1;
+}
+
+char itop(int a)
+{
+	return (a < 10) ? ('0' + a) : ('a' + a - 10);
+}
+
+uint32_t crc32(const std::string& s)
+{
+	uint32_t crc = 0xffffffff;
+	for( unsigned char c : s ) {
+		crc ^= c;
+		for( int j = 0; j < 8; ++j ) {
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+		}
+	}
+	return ~crc;
+}
+
+// Slot bytecode from hex, as m#= takes it.
+bool hex2bin(const std::string& h, std::string& b)
+{
+	if( h.size() % 2 || h.size() > 2 * PWD_SIZE ) return false;
+	b.clear();
+	for( size_t i = 0; i < h.size(); i += 2 ) {
+		int hi = ptoi(h[i]), lo = ptoi(h[i + 1]);
+		if( hi < 0 || hi > 15 || lo < 0 || lo > 15 ) return false;
+		b.push_back(char(hi << 4 | lo));
+	}
+	return true;
+}
+
+std::string bin2hex(const std::string& b)
+{
+	std::string h;
+	for( unsigned char c : b ) {
+		h += itop(c >> 4);
+		h += itop(c & 0x0f);
+	}
+	return h;
+}
+
+bool load_vault(const char* fn, Slots& slots)
+{
+	std::ifstream f(fn);
+	if( !f ) { std::fprintf(stderr, "can't open %s\n", fn); return false; }
+
+	slots.assign(PWD_COUNT, std::string());
+	std::string line;
+	int ln = 0;
+	while( std::getline(f, line) ) {
+		++ln;
+		while( !line.empty() && (line.back() == '\r' || line.back() == '\n') ) line.pop_back();
+		if( line.empty() || line[0] == '#' ) continue;
+
+		int n = (line.size() >= 3) ? ptoi(line[1]) : -1;
+		bool ok = (line[0] == 'p' || line[0] == 'm') && n >= 1 && n < PWD_COUNT && line[2] == '=';
+		if( ok && line[0] == 'p' ) ok = line.size() - 3 <= PWD_SIZE;
+		if( ok && line[0] == 'm' ) ok = hex2bin(line.substr(3), slots[n]);
+		if( !ok ) {
+			std::fprintf(stderr, "%s:%d: expected p#=password or m#=hex\n", fn, ln);
+			return false;
+		}
+		if( line[0] == 'p' ) slots[n] = line.substr(3);
+	}
+
+	for( auto& s : slots ) s.resize(PWD_SIZE, '\0');
+	return true;
+}
+
+// The slot as the command that stores it, as Ser_SendSlotCmd prints it.
+std::string slot_cmd(int n, const std::string& b)
+{
+	size_t len = 0;
+	bool text = true;
+	for( size_t i = 0; i < b.size(); ++i ) {
+		unsigned char c = b[i];
+		if( c == 0 ) continue;
+		if( len != i || c < ' ' || c > '~' ) text = false; // gap or op
+		len = i + 1;
+	}
+	std::string v = b.substr(0, len);
+	return std::string(1, text ? 'p' : 'm') + itop(n) + "=" + (text ? v : bin2hex(v));
+}
+
+// Opens the first hidraw node with the setup mode USB ids.
+int find_device(std::string& path)
+{
+	DIR* d = opendir("/dev");
+	if( !d ) return -1;
+
+	int fd = -1;
+	while( dirent* de = readdir(d) ) {
+		if( std::strncmp(de->d_name, "hidraw", 6) ) continue;
+		std::string p = std::string("/dev/") + de->d_name;
+		int f = open(p.c_str(), O_RDWR);
+		if( f < 0 ) continue;
+
+		hidraw_devinfo info;
+		if( ioctl(f, HIDIOCGRAWINFO, &info) == 0 && (info.vendor & 0xffff) == VENDOR_ID && (info.product & 0xffff) == PRODUCT_ID ) {
+			path = p;
+			fd = f;
+			break;
+		}
+		close(f);
+	}
+
+	closedir(d);
+	return fd;
+}
+
+// Feature reports, read again while the device is storing one.
+class Hid
+{
+public:
+	Hid(int fd, int timeout_ms) : fd_(fd), timeout_ms_(timeout_ms) {}
+
+	int transfers = 0; // control transfers, with the ones answered busy
+	std::vector<bool> bad = std::vector<bool>(PWD_COUNT); // slots that failed the device's check when last read
+
+	bool set(int n, const Slots& slots)
+	{
+		uint8_t b[REPORT_SIZE] = {0};
+		b[0] = n;
+		for( int i = 0; i < REPORT_SLOTS && n + i < PWD_COUNT; ++i ) {
+			std::memcpy(b + 2 + i * PWD_SIZE, slots[n + i].data(), PWD_SIZE);
+		}
+		++transfers;
+		return ioctl(fd_, HIDIOCSFEATURE(REPORT_SIZE), b) == REPORT_SIZE;
+	}
+
+	bool get(int n, Slots& slots)
+	{
+		uint8_t b[REPORT_SIZE];
+		auto until = Clock::now() + std::chrono::milliseconds(timeout_ms_);
+		while( true ) {
+			++transfers;
+			std::memset(b, 0, sizeof(b));
+			b[0] = n;
+			if( ioctl(fd_, HIDIOCGFEATURE(REPORT_SIZE), b) != REPORT_SIZE ) return false;
+			if( b[0] != n ) { errno = EPROTO; return false; }
+			if( !(b[1] & STATUS_BUSY) ) break;
+			if( Clock::now() > until ) { errno = ETIMEDOUT; return false; }
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		for( int i = 0; i < REPORT_SLOTS && n + i < PWD_COUNT; ++i ) {
+			slots[n + i].assign(reinterpret_cast<char*>(b + 2 + i * PWD_SIZE), PWD_SIZE);
+			bad[n + i] = b[1] & (STATUS_BAD << i);
+		}
+		return true;
+	}
+
+private:
+
+	int fd_;
+	int timeout_ms_;
+};
+
+// Stores all slots and reads them back, true if they match.
+bool hid_store(Hid& hid, const Slots& slots, std::string& err)
+{
+	Slots back(PWD_COUNT);
+	for( int n = 1; n < PWD_COUNT; n += REPORT_SLOTS ) {
+		if( !hid.set(n, slots) ) { err = std::string("SET_REPORT ") + itop(n) + ": " + std::strerror(errno); return false; }
+		if( !hid.get(n, back) ) { err = std::string("GET_REPORT ") + itop(n) + ": " + std::strerror(errno); return false; }
+		for( int i = n; i < n + REPORT_SLOTS && i < PWD_COUNT; ++i ) {
+			if( back[i] != slots[i] ) { err = std::string("slot ") + itop(i) + " mismatch"; return false; }
+			if( hid.bad[i] ) { err = std::string("slot ") + itop(i) + " fails its check"; return false; }
+		}
+	}
+	return true;
+}
+
+bool hid_load(Hid& hid, Slots& slots, std::string& err)
+{
+	slots.assign(PWD_COUNT, std::string(PWD_SIZE, '\0'));
+	for( int n = 1; n < PWD_COUNT; n += REPORT_SLOTS ) {
+		if( !hid.get(n, slots) ) { err = std::string("GET_REPORT ") + itop(n) + ": " + std::strerror(errno); return false; }
+	}
+	return true;
+}
+
+// The same store over the serial port: m#= for every slot, then H? against the vault's CRCs.
+bool cdc_store(const char* path, const Slots& slots, int timeout_ms, int& bytes, std::string& err)
+{
+	int fd = open(path, O_RDWR | O_NOCTTY);
+	if( fd < 0 ) { err = std::strerror(errno); return false; }
+	termios t;
+	if( tcgetattr(fd, &t) == 0 ) {
+		cfmakeraw(&t);
+		cfsetspeed(&t, B115200); // sets line encoding, which opens the device port
+		t.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(fd, TCSANOW, &t);
+	}
+	tcflush(fd, TCIOFLUSH);
+
+	std::string out, want;
+	for( int n = 1; n < PWD_COUNT; ++n ) {
+		out += std::string("m") + itop(n) + "=" + bin2hex(slots[n]) + "\r\n";
+		want += "sto\r\n";
+	}
+	out += "H?\r\n";
+	for( int n = 1; n < PWD_COUNT; ++n ) {
+		char l[16];
+		std::snprintf(l, sizeof(l), "%c:%08x\r\n", itop(n), crc32(slots[n]));
+		want += l;
+	}
+	want += "end\r\n";
+	bytes = out.size() + want.size();
+
+	// the device takes commands as fast as it stores them, the kernel holds the rest
+	bool ok = write(fd, out.data(), out.size()) == ssize_t(out.size());
+	std::string in;
+	auto until = Clock::now() + std::chrono::milliseconds(timeout_ms);
+	while( ok && in.size() < want.size() && Clock::now() < until ) {
+		pollfd pfd = {fd, POLLIN, 0};
+		if( poll(&pfd, 1, 100) <= 0 ) continue;
+		char b[256];
+		ssize_t r = read(fd, b, sizeof(b));
+		if( r <= 0 ) break;
+		in.append(b, r);
+	}
+	close(fd);
+
+	if( !ok ) { err = "write failed"; return false; }
+	if( in != want ) { err = "unexpected reply: " + in.substr(0, 40); return false; }
+	return true;
+}
+
+double since(Clock::time_point t0)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+void usage()
+{
+	std::fprintf(stderr, "usage: pwhid [-d /dev/hidrawN] [-t timeout_ms] vault.txt\n"
+		"       pwhid [-d /dev/hidrawN] -r\n"
+		"       pwhid [-d /dev/hidrawN] -b /dev/ttyACMx vault.txt\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::string path;
+	const char* tty = nullptr;
+	bool read_only = false;
+	int timeout_ms = 2000;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "d:rb:t:")) != -1 ) {
+		switch( opt ) {
+			case 'd': path = optarg; break;
+			case 'r': read_only = true; break;
+			case 'b': tty = optarg; break;
+			case 't': timeout_ms = std::atoi(optarg); break;
+			default: usage(); return 2;
+		}
+	}
+	if( argc - optind != (read_only ? 0 : 1) || (read_only && tty) ) { usage(); return 2; }
+
+	int fd = path.empty() ? find_device(path) : open(path.c_str(), O_RDWR);
+	if( fd < 0 ) {
+		std::fprintf(stderr, "%s: %s\n", path.empty() ? "pwd setup" : path.c_str(),
+			path.empty() ? "not found" : std::strerror(errno));
+		return 2;
+	}
+	Hid hid(fd, timeout_ms);
+	std::string err;
+
+	if( read_only ) {
+		Slots slots;
+		if( !hid_load(hid, slots, err) ) { std::fprintf(stderr, "%s: %s\n", path.c_str(), err.c_str()); return 1; }
+		for( int n = 1; n < PWD_COUNT; ++n ) {
+			if( hid.bad[n] ) std::printf("# bad\n"); // as L? marks it
+			std::printf("%s\n", slot_cmd(n, slots[n]).c_str());
+		}
+		return 0;
+	}
+
+	Slots slots;
+	if( !load_vault(argv[optind], slots) ) return 2;
+
+	if( tty ) {
+		// slot writes skip bytes that don't change, so both paths start from empty slots
+		Slots empty(PWD_COUNT, std::string(PWD_SIZE, '\0'));
+		int bytes = 0;
+		if( !hid_store(hid, empty, err) ) { std::fprintf(stderr, "%s: %s\n", path.c_str(), err.c_str()); return 1; }
+		auto t0 = Clock::now();
+		if( !cdc_store(tty, slots, 10 * timeout_ms, bytes, err) ) { std::fprintf(stderr, "%s: %s\n", tty, err.c_str()); return 1; }
+		double cdc_ms = since(t0);
+
+		if( !hid_store(hid, empty, err) ) { std::fprintf(stderr, "%s: %s\n", path.c_str(), err.c_str()); return 1; }
+		hid.transfers = 0;
+		t0 = Clock::now();
+		if( !hid_store(hid, slots, err) ) { std::fprintf(stderr, "%s: %s\n", path.c_str(), err.c_str()); return 1; }
+		double hid_ms = since(t0);
+
+		std::printf("cdc: %.0f ms, %d bytes of commands and replies\n", cdc_ms, bytes);
+		std::printf("hid: %.0f ms, %d control transfers\n", hid_ms, hid.transfers);
+		return 0;
+	}
+
+	auto t0 = Clock::now();
+	bool ok = hid_store(hid, slots, err);
+	std::printf("%s: %s %.0f ms, %d control transfers%s%s\n", path.c_str(), ok ? "ok" : "FAILED",
+		since(t0), hid.transfers, ok ? "" : " ", err.c_str());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+/**
+password typist
+
+@file		pwprov.cpp
+@brief		Provisions many devices in parallel over their setup mode serial ports.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build: g++ -std=c++17 -O2 -pthread -o pwprov pwprov.cpp
+
+Usage: pwprov [-c] [-w window] [-t timeout_ms] vault.txt port...
+
+The vault file holds p#=text and m#=hex lines, the same form L? prints.
+Blank lines and lines starting with # are ignored. Every port gets its own
+worker that sends the store commands without waiting for each reply, keeping
+at most window commands in flight. Replies come back in command order, so they are matched
+to commands by position. Each device is then verified with H? against
+CRC-32s computed from the vault. Any tty works as a port, including the pty
+of a stand-in device.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int PWD_SIZE = 32;
+constexpr int PWD_COUNT = 16;
+
+using Clock = std::chrono::steady_clock;
+
+struct Command
+{
+	std::string line; // sent to device, without line ending
+	std::string expect; // expected reply
+};
+
+struct Result
+{
+	std::string port;
+	bool ok = false;
+	std::string error;
+	double seconds = 0;
+};
+
+std::mutex log_mutex;
+
+uint32_t crc32(const uint8_t* p, size_t n)
+{
+	uint32_t crc = 0xffffffff;
+	while( n-- ) {
+		crc ^= *p++;
+		for( int j = 0; j < 8; ++j ) {
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+		}
+	}
+	return ~crc;
+}
+
+int ptoi(char c)
+{
+	if( c >= '0' && c <= '9' ) return c - '0';
+	if( c >= 'a' && c <= 'z' ) return c - 'a' + 10;
+	return -1;
+}
+
+char itop(int a)
+{
+	return (a < 10) ? ('0' + a) : ('a' + a - 10);
+}
+
+// Slot bytecode from hex, as m#= takes it.
+bool hex2bin(const std::string& h, std::string& b)
+{
+	if( h.size() % 2 || h.size() > 2 * PWD_SIZE ) return false;
+	b.clear();
+	for( size_t i = 0; i < h.size(); i += 2 ) {
+		int hi = ptoi(h[i]), lo = ptoi(h[i + 1]);
+		if( hi < 0 || hi > 15 || lo < 0 || lo > 15 ) return false;
+		b.push_back(char(hi << 4 | lo));
+	}
+	return true;
+}
+
+// Serial port with line oriented reads.
+class Port
+{
+public:
+	explicit Port(const std::string& path) : path_(path) {}
+	~Port() { if( fd_ >= 0 ) close(fd_); }
+
+	bool open_raw(std::string& err)
+	{
+		fd_ = ::open(path_.c_str(), O_RDWR | O_NOCTTY);
+		if( fd_ < 0 ) { err = std::strerror(errno); return false; }
+
+		termios t;
+		if( tcgetattr(fd_, &t) == 0 ) {
+			cfmakeraw(&t);
+			cfsetspeed(&t, B115200); // sets line encoding, which opens the device port
+			t.c_cflag |= CLOCAL | CREAD;
+			tcsetattr(fd_, TCSANOW, &t);
+		}
+		tcflush(fd_, TCIOFLUSH);
+		return true;
+	}
+
+	bool write_line(const std::string& s)
+	{
+		std::string b = s + "\r\n";
+		const char* p = b.data();
+		size_t n = b.size();
+		while( n ) {
+			ssize_t w = ::write(fd_, p, n);
+			if( w < 0 ) {
+				if( errno == EINTR || errno == EAGAIN ) continue;
+				return false;
+			}
+			p += w;
+			n -= w;
+		}
+		return true;
+	}
+
+	// Next non-empty line, false on timeout or error.
+	bool read_line(std::string& line, int timeout_ms)
+	{
+		auto until = Clock::now() + std::chrono::milliseconds(timeout_ms);
+		while( true ) {
+			size_t e = buf_.find_first_of("\r\n");
+			while( e == 0 ) { buf_.erase(0, 1); e = buf_.find_first_of("\r\n"); }
+			if( e != std::string::npos ) {
+				line = buf_.substr(0, e);
+				buf_.erase(0, e + 1);
+				return true;
+			}
+
+			int left = std::chrono::duration_cast<std::chrono::milliseconds>(until - Clock::now()).count();
+			if( left <= 0 ) return false;
+
+			pollfd pfd = {fd_, POLLIN, 0};
+			int r = poll(&pfd, 1, left);
+			if( r < 0 && errno == EINTR ) continue;
+			if( r <= 0 ) return false;
+
+			char b[256];
+			ssize_t n = ::read(fd_, b, sizeof(b));
+			if( n <= 0 ) return false;
+			buf_.append(b, n);
+		}
+	}
+
+	// True if a reply is ready without waiting.
+	bool readable()
+	{
+		if( buf_.find_first_of("\r\n") != std::string::npos ) return true;
+		pollfd pfd = {fd_, POLLIN, 0};
+		return poll(&pfd, 1, 0) > 0;
+	}
+
+private:
+	std::string path_;
+	int fd_ = -1;
+	std::string buf_;
+};
+
+// Sends commands keeping up to window of them in flight, matches replies in order.
+bool pipeline(Port& port, const std::vector<Command>& cmds, size_t window, int timeout_ms, std::string& err)
+{
+	std::deque<const Command*> inflight;
+	size_t next = 0;
+
+	while( next < cmds.size() || !inflight.empty() ) {
+		while( next < cmds.size() && inflight.size() < window ) {
+			if( !port.write_line(cmds[next].line) ) { err = "write failed"; return false; }
+			inflight.push_back(&cmds[next]);
+			++next;
+			if( port.readable() ) break;
+		}
+
+		std::string r;
+		if( !port.read_line(r, timeout_ms) ) { err = "timeout waiting for reply to " + inflight.front()->line; return false; }
+		if( r != inflight.front()->expect ) { err = inflight.front()->line + ": " + r; return false; }
+		inflight.pop_front();
+	}
+
+	return true;
+}
+
+// Checks H? reply against expected slot CRCs.
+bool verify(Port& port, const std::vector<uint32_t>& crcs, int timeout_ms, std::string& err)
+{
+	if( !port.write_line("H?") ) { err = "write failed"; return false; }
+
+	for( int n = 1; n < PWD_COUNT; ++n ) {
+		std::string r;
+		if( !port.read_line(r, timeout_ms) ) { err = "timeout in H?"; return false; }
+		char want[16];
+		std::snprintf(want, sizeof(want), "%c:%08x", itop(n), crcs[n]);
+		if( r != want ) { err = std::string("slot ") + itop(n) + " mismatch: " + r; return false; }
+	}
+
+	std::string r;
+	if( !port.read_line(r, timeout_ms) || r != "end" ) { err = "H? not terminated"; return false; }
+	return true;
+}
+
+void worker(Result& res, const std::vector<Command>& cmds, const std::vector<uint32_t>& crcs, size_t window, int timeout_ms)
+{
+	auto t0 = Clock::now();
+	Port port(res.port);
+
+	res.ok = port.open_raw(res.error)
+		&& pipeline(port, cmds, window, timeout_ms, res.error)
+		&& verify(port, crcs, timeout_ms, res.error);
+
+	res.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+	std::lock_guard<std::mutex> lock(log_mutex);
+	std::printf("%s: %s %.2fs%s%s\n", res.port.c_str(), res.ok ? "ok" : "FAILED", res.seconds,
+		res.ok ? "" : " ", res.error.c_str());
+}
+
+bool load_vault(const char* fn, std::vector<Command>& cmds, std::vector<uint32_t>& crcs)
+{
+	std::ifstream f(fn);
+	if( !f ) { std::fprintf(stderr, "can't open %s\n", fn); return false; }
+
+	std::vector<std::string> slots(PWD_COUNT); // slot bytes
+	std::vector<std::string> cmd(PWD_COUNT); // vault line that stores them
+	std::string line;
+	int ln = 0;
+	while( std::getline(f, line) ) {
+		++ln;
+		while( !line.empty() && (line.back() == '\r' || line.back() == '\n') ) line.pop_back();
+		if( line.empty() || line[0] == '#' ) continue;
+
+		int n = (line.size() >= 3) ? ptoi(line[1]) : -1;
+		bool ok = (line[0] == 'p' || line[0] == 'm') && n >= 1 && n < PWD_COUNT && line[2] == '=';
+		if( ok && line[0] == 'p' ) ok = line.size() - 3 <= PWD_SIZE;
+		if( ok && line[0] == 'm' ) ok = hex2bin(line.substr(3), slots[n]);
+		if( !ok ) {
+			std::fprintf(stderr, "%s:%d: expected p#=password or m#=hex\n", fn, ln);
+			return false;
+		}
+		if( line[0] == 'p' ) slots[n] = line.substr(3);
+		cmd[n] = line;
+	}
+
+	// unlisted slots are stored empty so the device ends up matching the vault exactly
+	crcs.assign(PWD_COUNT, 0);
+	for( int n = 1; n < PWD_COUNT; ++n ) {
+		cmds.push_back({cmd[n].empty() ? std::string("p") + itop(n) + "=" : cmd[n], "sto"});
+		uint8_t b[PWD_SIZE] = {0};
+		std::memcpy(b, slots[n].data(), slots[n].size());
+		crcs[n] = crc32(b, PWD_SIZE);
+	}
+
+	return true;
+}
+
+void usage()
+{
+	std::fprintf(stderr, "usage: pwprov [-c] [-w window] [-t timeout_ms] vault.txt port...\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	bool clear = false;
+	size_t window = 4;
+	int timeout_ms = 5000; // c! takes a few seconds
+
+	int opt;
+	while( (opt = getopt(argc, argv, "cw:t:")) != -1 ) {
+		switch( opt ) {
+			case 'c': clear = true; break;
+			case 'w': window = std::max(1, std::atoi(optarg)); break;
+			case 't': timeout_ms = std::atoi(optarg); break;
+			default: usage(); return 2;
+		}
+	}
+	if( argc - optind < 2 ) { usage(); return 2; }
+
+	std::vector<Command> cmds;
+	std::vector<uint32_t> crcs;
+	if( clear ) cmds.push_back({"c!", "clr"});
+	if( !load_vault(argv[optind], cmds, crcs) ) return 2;
+
+	std::vector<Result> res(argc - optind - 1);
+	for( size_t i = 0; i < res.size(); ++i ) res[i].port = argv[optind + 1 + i];
+
+	auto t0 = Clock::now();
+	std::vector<std::thread> th;
+	for( auto& r : res ) th.emplace_back(worker, std::ref(r), std::cref(cmds), std::cref(crcs), window, timeout_ms);
+	for( auto& t : th ) t.join();
+	double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+	size_t ok = 0;
+	for( auto& r : res ) ok += r.ok;
+
+	std::printf("%zu/%zu devices provisioned in %.2fs, %.1f devices/minute\n",
+		ok, res.size(), secs, secs > 0 ? ok * 60.0 / secs : 0.0);
+
+	return (ok == res.size()) ? 0 : 1;
+}
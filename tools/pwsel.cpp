@@ -0,0 +1,190 @@
+/**
+password typist
+
+@file		pwsel.cpp
+@brief		Picks the slot a keyboard mode device types, over its lock key LEDs.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Build: g++ -std=c++17 -O2 -o pwsel pwsel.cpp
+
+Usage: pwsel [-d /dev/input/eventN] [-g gap_ms] [-w] [-t timeout_ms] slot
+
+Sends the LED channel frame described in main.h by writing lock key LED events
+to the device's evdev node, which the kernel passes on as LED output reports.
+Slot 0 retypes the slot the device typed last. The LED state found is restored
+afterwards. Without -d the first input device whose name contains
+"pwd keyboard" is used. LED reports closer than gap_ms may be merged by the
+kernel, so symbols are sent gap_ms apart (20 by default).
+
+With -w the device's key events are grabbed, so the retyped text goes nowhere,
+and the time from the last LED report to the first key press is printed.
+Writing to evdev nodes usually needs root.
+*/
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+
+namespace {
+
+constexpr int PWD_COUNT = 16;
+
+using Clock = std::chrono::steady_clock;
+
+// Opens the first event node with the device's name in it.
+int find_device(std::string& path)
+{
+	DIR* d = opendir("/dev/input");
+	if( !d ) return -1;
+
+	int fd = -1;
+	while( dirent* de = readdir(d) ) {
+		if( std::strncmp(de->d_name, "event", 5) ) continue;
+		std::string p = std::string("/dev/input/") + de->d_name;
+		int f = open(p.c_str(), O_RDWR | O_NONBLOCK);
+		if( f < 0 ) continue;
+
+		char name[256] = "";
+		ioctl(f, EVIOCGNAME(sizeof(name)), name);
+		if( std::strstr(name, "pwd keyboard") ) {
+			path = p;
+			fd = f;
+			break;
+		}
+		close(f);
+	}
+
+	closedir(d);
+	return fd;
+}
+
+bool emit(int fd, int type, int code, int value)
+{
+	input_event e;
+	std::memset(&e, 0, sizeof(e));
+	e.type = type;
+	e.code = code;
+	e.value = value;
+	return write(fd, &e, sizeof(e)) == sizeof(e);
+}
+
+// One LED report: num lock is bit 0 of sym, caps lock bit 1.
+bool set_leds(int fd, int sym, bool scroll)
+{
+	return emit(fd, EV_LED, LED_NUML, sym & 1)
+		&& emit(fd, EV_LED, LED_CAPSL, (sym >> 1) & 1)
+		&& emit(fd, EV_LED, LED_SCROLLL, scroll)
+		&& emit(fd, EV_SYN, SYN_REPORT, 0);
+}
+
+// Waits for the first key press, returns ms since t0 or -1 on timeout.
+double wait_key(int fd, Clock::time_point t0, int timeout_ms)
+{
+	auto until = t0 + std::chrono::milliseconds(timeout_ms);
+	while( true ) {
+		int left = std::chrono::duration_cast<std::chrono::milliseconds>(until - Clock::now()).count();
+		if( left <= 0 ) return -1;
+
+		pollfd pfd = {fd, POLLIN, 0};
+		int r = poll(&pfd, 1, left);
+		if( r < 0 && errno == EINTR ) continue;
+		if( r <= 0 ) return -1;
+
+		input_event e;
+		while( read(fd, &e, sizeof(e)) == sizeof(e) ) {
+			if( e.type == EV_KEY && e.value == 1 ) {
+				return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+			}
+		}
+	}
+}
+
+void usage()
+{
+	std::fprintf(stderr, "usage: pwsel [-d /dev/input/eventN] [-g gap_ms] [-w] [-t timeout_ms] slot\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::string path;
+	int gap_ms = 20;
+	bool wait = false;
+	int timeout_ms = 5000;
+
+	int opt;
+	while( (opt = getopt(argc, argv, "d:g:wt:")) != -1 ) {
+		switch( opt ) {
+			case 'd': path = optarg; break;
+			case 'g': gap_ms = std::atoi(optarg); break;
+			case 'w': wait = true; break;
+			case 't': timeout_ms = std::atoi(optarg); break;
+			default: usage(); return 2;
+		}
+	}
+	if( argc - optind != 1 ) { usage(); return 2; }
+
+	int slot = std::atoi(argv[optind]);
+	if( slot < 0 || slot >= PWD_COUNT ) { usage(); return 2; }
+
+	int fd = path.empty() ? find_device(path) : open(path.c_str(), O_RDWR | O_NONBLOCK);
+	if( fd < 0 ) {
+		std::fprintf(stderr, "%s: %s\n", path.empty() ? "pwd keyboard" : path.c_str(),
+			path.empty() ? "not found" : std::strerror(errno));
+		return 2;
+	}
+
+	uint8_t led[(LED_MAX + 7) / 8] = {0};
+	ioctl(fd, EVIOCGLED(sizeof(led)), led);
+	int num = led[0] >> LED_NUML & 1, caps = led[0] >> LED_CAPSL & 1;
+	bool scroll = led[0] >> LED_SCROLLL & 1;
+
+	if( wait ) {
+		ioctl(fd, EVIOCGRAB, 1);
+		input_event e;
+		while( read(fd, &e, sizeof(e)) == sizeof(e) ); // stale events
+	}
+
+	int hi = slot >> 2, lo = slot & 3;
+	const int sym[] = {3, 0, 3, hi, lo, ~(hi ^ lo) & 3};
+
+	bool ok = true;
+	for( int s : sym ) { // every symbol toggles scroll lock
+		scroll = !scroll;
+		ok &= set_leds(fd, s, scroll);
+		std::this_thread::sleep_for(std::chrono::milliseconds(gap_ms));
+	}
+	ok &= set_leds(fd, num | caps << 1, scroll); // six toggles left scroll lock as it was
+	auto t0 = Clock::now();
+
+	if( !ok ) {
+		std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+		return 1;
+	}
+
+	if( wait ) {
+		double ms = wait_key(fd, t0, timeout_ms);
+		if( ms < 0 ) {
+			std::fprintf(stderr, "%s: no keys within %d ms\n", path.c_str(), timeout_ms);
+			return 1;
+		}
+		std::printf("%s: slot %d typing %.1f ms after the last LED report\n", path.c_str(), slot, ms);
+	}
+
+	close(fd);
+	return 0;
+}
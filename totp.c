@@ -0,0 +1,72 @@
+/**
+password typist
+
+@file		totp.c
+@brief		RFC 6238 time based one time codes from slot keys.
+@author		Matej Kogovsek
+@copyright	GPL v2
+*/
+
+#include <avr/io.h>
+
+#include "sha1.h"
+#include "rtc.h"
+#include "totp.h"
+#include "main.h"
+
+/**
+@brief Computes a TOTP code, HMAC-SHA1 with TOTP_STEP and TOTP_DIGITS.
+@param[out]	code	TOTP_DIGITS ascii digits, not terminated
+@param[in]	key		Shared secret
+@param[in]	klen	Secret length, at most SHA1_BLOCK
+@param[in]	t		Unix time
+*/
+void totp_code(char* code, const uint8_t* key, const uint8_t klen, const uint32_t t)
+{
+	uint8_t msg[8] = {0};
+	uint32_t c = t / TOTP_STEP;
+	uint8_t i;
+	for( i = 7; i > 3; --i ) {
+		msg[i] = c;
+		c >>= 8;
+	}
+
+	uint8_t mac[SHA1_HASH];
+	hmac_sha1(mac, key, klen, msg, sizeof(msg));
+
+	// dynamic truncation
+	uint8_t* p = mac + (mac[SHA1_HASH - 1] & 0x0f);
+	uint32_t v = ((uint32_t)(p[0] & 0x7f) << 24) | ((uint32_t)p[1] << 16) | ((uint16_t)p[2] << 8) | p[3];
+
+	for( i = TOTP_DIGITS; i > 0; --i ) {
+		code[i - 1] = '0' + v % 10;
+		v /= 10;
+	}
+}
+
+/**
+@brief Computes the current code of the first OP_TOTP in a slot.
+@param[out]	code	TOTP_DIGITS ascii digits, not terminated
+@param[in]	b		PWD_SIZE bytes of slot plaintext
+@return True on success, false if the slot has no TOTP key or time is not set.
+*/
+uint8_t totp_slot(char* code, const uint8_t* b)
+{
+	uint8_t pc = 0;
+	while( pc < PWD_SIZE ) {
+		uint8_t op = b[pc++];
+		if( op == OP_END ) break;
+		if( (op == OP_KEY) || (op == OP_LAYOUT) ) { ++pc; } else
+		if( op == OP_CHORD ) { pc += 2; } else
+		if( op == OP_TEST ) { pc += 3; } else
+		if( (op == OP_TOTP) && (pc < PWD_SIZE) ) {
+			uint8_t klen = b[pc++];
+			uint32_t t;
+			if( (klen > PWD_SIZE - pc) || !rtc_get(&t) ) break;
+			totp_code(code, b + pc, klen, t);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef TOTP_H
+#define TOTP_H
+
+#include <inttypes.h>
+
+#define TOTP_DIGITS 6
+#define TOTP_STEP 30 // seconds
+
+void totp_code(char* code, const uint8_t* key, const uint8_t klen, const uint32_t t);
+uint8_t totp_slot(char* code, const uint8_t* b);
+
+#endif
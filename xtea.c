@@ -0,0 +1,58 @@
+/**
+password typist
+
+@file		xtea.c
+@brief		XTEA block cipher with the key in flash.
+@author		Matej Kogovsek
+@copyright	GPL v2
+
+Only shifts by constants, additions and xors touch the data, and the key
+word index depends on the round only, so run time doesn't depend on the key
+or the data.
+*/
+
+#include <avr/pgmspace.h>
+
+#include "xtea.h"
+
+#define DELTA 0x9e3779b9
+
+/**
+@brief Encrypts one 64 bit block in place.
+@param[in]	v		Block, two words
+@param[in]	key		Key, four words in flash
+*/
+void xtea_encrypt(uint32_t* v, const uint32_t* key)
+{
+	uint32_t v0 = v[0], v1 = v[1], sum = 0;
+	uint8_t i;
+
+	for( i = 0; i < XTEA_ROUNDS; ++i ) {
+		v0 += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + pgm_read_dword(&key[sum & 3]));
+		sum += DELTA;
+		v1 += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + pgm_read_dword(&key[(sum >> 11) & 3]));
+	}
+
+	v[0] = v0;
+	v[1] = v1;
+}
+
+/**
+@brief Decrypts one 64 bit block in place.
+@param[in]	v		Block, two words
+@param[in]	key		Key, four words in flash
+*/
+void xtea_decrypt(uint32_t* v, const uint32_t* key)
+{
+	uint32_t v0 = v[0], v1 = v[1], sum = DELTA * XTEA_ROUNDS;
+	uint8_t i;
+
+	for( i = 0; i < XTEA_ROUNDS; ++i ) {
+		v1 -= (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + pgm_read_dword(&key[(sum >> 11) & 3]));
+		sum -= DELTA;
+		v0 -= (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + pgm_read_dword(&key[sum & 3]));
+	}
+
+	v[0] = v0;
+	v[1] = v1;
+}
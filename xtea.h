@@ -0,0 +1,11 @@
+#ifndef XTEA_H
+#define XTEA_H
+
+#include <inttypes.h>
+
+#define XTEA_ROUNDS 32
+
+void xtea_encrypt(uint32_t* v, const uint32_t* key);
+void xtea_decrypt(uint32_t* v, const uint32_t* key);
+
+#endif